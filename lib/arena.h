@@ -0,0 +1,297 @@
+/**
+ * @file arena.h
+ *
+ * Contains a bump allocator backed by huge pages. Memory is requested from the
+ * kernel in large blocks, trying 1GB or 2MB hugetlb pages first, then
+ * transparent huge pages through madvise and finally normal pages. When not
+ * even normal pages can be mapped the process is aborted, so callers never see
+ * a NULL pointer. Allocations are only released all at once when the arena is
+ * freed or reset, so it is meant for the fish arrays and the scratch buffers
+ * that live for the whole simulation.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_ARENA
+#define SIM_H_ARENA
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifndef MAP_HUGE_SHIFT
+    #define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+    #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+    #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define ARENA_SIZE_2MB ((size_t) 1 << 21)
+#define ARENA_SIZE_1GB ((size_t) 1 << 30)
+// Every allocation is aligned to at least a cache line, which also covers the
+// widest SIMD registers (AVX-512).
+#define ARENA_MIN_ALIGN 64
+// Size of a block when the allocation is smaller than this
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * ARENA_SIZE_2MB)
+
+/**
+ * @brief The kind of pages backing a block, in order of preference.
+ */
+typedef enum ArenaPageKind
+{
+    ARENA_PAGE_1GB,
+    ARENA_PAGE_2MB,
+    ARENA_PAGE_TRANSPARENT,
+    ARENA_PAGE_DEFAULT
+} ArenaPageKind;
+
+const char* ARENA_PAGE_KIND_NAMES[] = {
+    "1GB",
+    "2MB",
+    "transparent",
+    "default"
+};
+
+/**
+ * @brief A single mapping handed out by the arena.
+ */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next;
+    char* base;
+    size_t size;
+    size_t used;
+    ArenaPageKind pageKind;
+} ArenaBlock;
+
+/**
+ * @brief A list of blocks, allocations are served from the first block, 
+ * newest first, with enough room left.
+ */
+typedef struct Arena
+{
+    ArenaBlock* blocks;
+    // The most preferred page kind that will be tried for new blocks
+    ArenaPageKind preferredPageKind;
+    // The least preferred page kind that any block ended up with, the most
+    // preferred kind of all, ARENA_PAGE_1GB, until a block is mapped
+    ArenaPageKind worstPageKind;
+} Arena;
+
+/**
+ * Rounds the size up to a multiple of the given power of two.
+ *
+ * @param size the size to round
+ * @param multiple a power of two
+ *
+ * @return the rounded size
+ */
+size_t arena_round_up(size_t size, size_t multiple) {
+    return (size + multiple - 1) & ~(multiple - 1);
+}
+
+/**
+ * Maps memory of normal pages aligned to 2MB and asks for transparent huge
+ * pages unless only default pages were requested. The mapping is over sized
+ * and trimmed as mmap only guarantees the normal page alignment.
+ *
+ * @param size the size to map, a multiple of 2MB
+ * @param pageKind the kind of pages requested, ARENA_PAGE_TRANSPARENT or
+ * ARENA_PAGE_DEFAULT, receives the kind of pages used
+ *
+ * @return the start of the mapping or NULL on failure
+ */
+char* arena_map_transparent(size_t size, ArenaPageKind* pageKind) {
+    size_t mapSize = size + ARENA_SIZE_2MB;
+    char* raw = (char*) mmap(NULL, mapSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char* base;
+    size_t head;
+
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    base = (char*) arena_round_up((uintptr_t) raw, ARENA_SIZE_2MB);
+    head = base - raw;
+    if (head > 0) {
+        munmap(raw, head);
+    }
+    munmap(base + size, mapSize - head - size);
+
+    if (*pageKind == ARENA_PAGE_TRANSPARENT
+        && madvise(base, size, MADV_HUGEPAGE) != 0) {
+        *pageKind = ARENA_PAGE_DEFAULT;
+    }
+
+    return base;
+}
+
+/**
+ * Maps a new block of at least the given size, falling back through the page
+ * kinds starting from the preferred one.
+ *
+ * @param arena the arena the block is for
+ * @param minSize the minimum usable size of the block
+ *
+ * @return the new block or NULL if no memory could be mapped
+ */
+ArenaBlock* arena_block_new(Arena* arena, size_t minSize) {
+    ArenaBlock* block = (ArenaBlock*) malloc(sizeof(ArenaBlock));
+    char* base = NULL;
+    size_t size = 0;
+    ArenaPageKind pageKind = arena->preferredPageKind;
+
+    if (pageKind == ARENA_PAGE_1GB) {
+        size = arena_round_up(minSize, ARENA_SIZE_1GB);
+        base = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB, -1, 0);
+        if (base == MAP_FAILED) {
+            pageKind = ARENA_PAGE_2MB;
+        }
+    }
+
+    if (pageKind == ARENA_PAGE_2MB) {
+        size = arena_round_up(minSize, ARENA_SIZE_2MB);
+        base = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if (base == MAP_FAILED) {
+            pageKind = ARENA_PAGE_TRANSPARENT;
+        }
+    }
+
+    if (pageKind >= ARENA_PAGE_TRANSPARENT) {
+        size = arena_round_up(minSize, ARENA_SIZE_2MB);
+        base = arena_map_transparent(size, &pageKind);
+        if (base == NULL) {
+            free(block);
+            return NULL;
+        }
+    }
+
+    block->base = base;
+    block->size = size;
+    block->used = 0;
+    block->pageKind = pageKind;
+    block->next = arena->blocks;
+    arena->blocks = block;
+
+    if (pageKind > arena->worstPageKind) {
+        arena->worstPageKind = pageKind;
+    }
+
+    return block;
+}
+
+/**
+ * Creates a new, empty, arena. No memory is mapped until the first
+ * allocation.
+ *
+ * @param preferredPageKind the page kind to try first for every block
+ *
+ * @return a pointer to the newly created Arena
+ */
+Arena* arena_new(ArenaPageKind preferredPageKind) {
+    Arena* arena = (Arena*) malloc(sizeof(Arena));
+
+    arena->blocks = NULL;
+    arena->preferredPageKind = preferredPageKind;
+    arena->worstPageKind = ARENA_PAGE_1GB;
+
+    return arena;
+}
+
+/**
+ * Allocates memory from the arena. The memory is not initialised and stays
+ * valid until the arena is freed or reset.
+ *
+ * @param arena the arena to allocate from
+ * @param size the size in bytes
+ * @param align the alignment, a power of two, raised to ARENA_MIN_ALIGN
+ *
+ * @return a pointer to the memory, the process is aborted if no memory could
+ * be mapped
+ */
+void* arena_alloc(Arena* arena, size_t size, size_t align) {
+    ArenaBlock* block = arena->blocks;
+    size_t offset = 0;
+
+    if (align < ARENA_MIN_ALIGN) {
+        align = ARENA_MIN_ALIGN;
+    }
+
+    while (block != NULL) {
+        offset = arena_round_up(block->used, align);
+        if (offset + size <= block->size) {
+            break;
+        }
+        block = block->next;
+    }
+
+    if (block == NULL) {
+        size_t blockSize = size + align;
+        if (blockSize < ARENA_DEFAULT_BLOCK_SIZE) {
+            blockSize = ARENA_DEFAULT_BLOCK_SIZE;
+        }
+
+        block = arena_block_new(arena, blockSize);
+        if (block == NULL) {
+            // Normal pages are the last fallback, malloc would fail as well
+            perror("arena_alloc");
+            abort();
+        }
+        // Blocks are at least 2MB aligned
+        offset = 0;
+    }
+
+    block->used = offset + size;
+    return block->base + offset;
+}
+
+/**
+ * Releases every allocation at once but keeps the blocks mapped, so the pages
+ * already touched are reused by the next allocations without faulting.
+ *
+ * @param arena the arena to reset
+ */
+void arena_reset(Arena* arena) {
+    for (ArenaBlock* block = arena->blocks; block != NULL; block = block->next) {
+        block->used = 0;
+    }
+}
+
+/**
+ * Unmaps every block and frees the arena.
+ *
+ * @param arena the arena to be freed
+ */
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        munmap(block->base, block->size);
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+/**
+ * Returns the number of page faults, minor and major, of this process so far.
+ *
+ * @return the number of page faults
+ */
+long arena_page_faults() {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+#endif
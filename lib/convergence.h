@@ -0,0 +1,211 @@
+/**
+ * @file convergence.h
+ *
+ * Contains the convergence monitor of the simulation. It tracks the barycentre,
+ * the objective value and the max deltaF, and tells when the school has
+ * stabilised so the simulation can stop.
+ *
+ * The change between two steps says little. The objective sits on a flat point
+ * right after the start before the school speeds up, and the max deltaF jumps
+ * between a few float values. So the steps are grouped into windows of
+ * SIM_CONV_WINDOW steps and every value is judged on the means of the windows,
+ * raised by SIM_CONV_NOISE_SIGMAS standard errors of the scatter of the steps
+ * around them. A value the noise hides from its tolerance is never stable.
+ *
+ * The barycentre and the objective are stable when the change of the mean from
+ * the previous window, relative to the mean and per step, is within their
+ * tolerance. The max deltaF is the best improvement of any fish in a step, it
+ * stays at the swim range while the fishes move freely and only falls once
+ * they stop improving. It is stable when its mean has fallen to its tolerance
+ * as a fraction of the mean of the first window.
+ *
+ * The monitored values are the global ones every process already holds after
+ * the reductions of a step, so every process reaches the same decision without
+ * any extra communication.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_CONVERGENCE
+#define SIM_H_CONVERGENCE
+
+#include <math.h>
+
+// The relative change per step, averaged over a window, below which the
+// barycentre and the objective are considered stable
+#ifndef SIM_CONV_TOL
+    #define SIM_CONV_TOL 1e-6
+#endif
+#ifndef SIM_CONV_TOL_BARYCENTRE
+    #define SIM_CONV_TOL_BARYCENTRE SIM_CONV_TOL
+#endif
+#ifndef SIM_CONV_TOL_OBJECTIVE
+    #define SIM_CONV_TOL_OBJECTIVE SIM_CONV_TOL
+#endif
+// The fraction of the first window below which the max deltaF is considered
+// stable
+#ifndef SIM_CONV_TOL_MAX_DELTA_F
+    #define SIM_CONV_TOL_MAX_DELTA_F 0.1
+#endif
+// The amount of steps whose values are averaged into one window
+#ifndef SIM_CONV_WINDOW
+    #define SIM_CONV_WINDOW 10
+#endif
+// The standard errors of the noise added to the change of the window means
+#ifndef SIM_CONV_NOISE_SIGMAS
+    #define SIM_CONV_NOISE_SIGMAS 2.0
+#endif
+// The amount of consecutive stable windows required to converge
+#ifndef SIM_CONV_PATIENCE
+    #define SIM_CONV_PATIENCE 3
+#endif
+
+typedef enum ConvCriterion {
+    CONV_BARYCENTRE,
+    CONV_OBJECTIVE,
+    CONV_MAX_DELTA_F,
+    CONV_CRITERION_COUNT
+} ConvCriterion;
+
+const char* CONV_CRITERION_NAMES[CONV_CRITERION_COUNT] = {
+    "barycentre",
+    "objective",
+    "max_delta_f"
+};
+
+/**
+ * @brief The state of the convergence monitor.
+ */
+typedef struct Convergence
+{
+    double tolerances[CONV_CRITERION_COUNT];
+    // The first value of the current window, the sums are taken relative to it
+    // so the variance does not cancel out against the large values
+    double reference[CONV_CRITERION_COUNT];
+    double sum[CONV_CRITERION_COUNT];
+    double sumSquares[CONV_CRITERION_COUNT];
+    // The mean of the first window and the mean and variance of the previous
+    double firstMean[CONV_CRITERION_COUNT];
+    double previousMean[CONV_CRITERION_COUNT];
+    double previousVariance[CONV_CRITERION_COUNT];
+    // The amount of consecutive windows each value has been stable for
+    int stableWindows[CONV_CRITERION_COUNT];
+    // The amount of steps in the current window
+    int windowSteps;
+    int windows;
+} Convergence;
+
+/**
+ * Initialises the convergence monitor with the compile time tolerances.
+ *
+ * @param conv the convergence monitor
+ */
+void convergence_init(Convergence* conv) {
+    conv->tolerances[CONV_BARYCENTRE] = SIM_CONV_TOL_BARYCENTRE;
+    conv->tolerances[CONV_OBJECTIVE] = SIM_CONV_TOL_OBJECTIVE;
+    conv->tolerances[CONV_MAX_DELTA_F] = SIM_CONV_TOL_MAX_DELTA_F;
+    for (int k = 0; k < CONV_CRITERION_COUNT; k++) {
+        conv->reference[k] = 0.0;
+        conv->sum[k] = 0.0;
+        conv->sumSquares[k] = 0.0;
+        conv->firstMean[k] = 0.0;
+        conv->previousMean[k] = 0.0;
+        conv->previousVariance[k] = 0.0;
+        conv->stableWindows[k] = 0;
+    }
+    conv->windowSteps = 0;
+    conv->windows = 0;
+}
+
+/**
+ * Adds the values of a step to the convergence monitor. Whether a value is
+ * stable is decided when a window is complete, see the file description, and
+ * the criterion is met when the value has been stable for SIM_CONV_PATIENCE
+ * consecutive windows.
+ *
+ * @param conv the convergence monitor
+ * @param values the values of the step, in the order of ConvCriterion
+ * @param any whether meeting any criterion converges, instead of all of them
+ *
+ * @return the criterion that converged, when all are required the one that
+ * became stable last, or -1 if not converged
+ */
+int convergence_update(
+    Convergence* conv,
+    const float values[CONV_CRITERION_COUNT],
+    int any) {
+    int met = 0;
+    int criterion = -1;
+
+    for (int k = 0; k < CONV_CRITERION_COUNT; k++) {
+        double value;
+
+        if (conv->windowSteps == 0) {
+            conv->reference[k] = values[k];
+        }
+        value = values[k] - conv->reference[k];
+        conv->sum[k] += value;
+        conv->sumSquares[k] += value * value;
+    }
+    conv->windowSteps++;
+
+    if (conv->windowSteps < SIM_CONV_WINDOW) {
+        return -1;
+    }
+
+    for (int k = 0; k < CONV_CRITERION_COUNT; k++) {
+        double mean = conv->sum[k] / SIM_CONV_WINDOW;
+        double variance = fmax(
+            (conv->sumSquares[k] - mean * conv->sum[k]) / (SIM_CONV_WINDOW - 1),
+            0.0);
+        double noise;
+        double change;
+
+        mean += conv->reference[k];
+        if (conv->windows == 0) {
+            conv->firstMean[k] = mean;
+        }
+
+        if (k == CONV_MAX_DELTA_F) {
+            noise = sqrt(variance / SIM_CONV_WINDOW);
+            change = (fabs(mean) + SIM_CONV_NOISE_SIGMAS * noise)
+                / fmax(fabs(conv->firstMean[k]), 1e-30);
+        } else {
+            noise = sqrt(
+                (variance + conv->previousVariance[k]) / SIM_CONV_WINDOW);
+            change = (fabs(mean - conv->previousMean[k])
+                + SIM_CONV_NOISE_SIGMAS * noise)
+                / (fmax(fabs(mean), 1e-30) * SIM_CONV_WINDOW);
+        }
+
+        // The first window has nothing to compare against
+        if (conv->windows > 0 && change <= conv->tolerances[k]) {
+            conv->stableWindows[k]++;
+        } else {
+            conv->stableWindows[k] = 0;
+        }
+        conv->previousMean[k] = mean;
+        conv->previousVariance[k] = variance;
+        conv->sum[k] = 0.0;
+        conv->sumSquares[k] = 0.0;
+
+        // The criterion that became stable last has the fewest stable windows,
+        // it is the one that decided the convergence when all are required
+        if (conv->stableWindows[k] >= SIM_CONV_PATIENCE) {
+            met++;
+            if (criterion < 0 || (!any
+                && conv->stableWindows[k] < conv->stableWindows[criterion])) {
+                criterion = k;
+            }
+        }
+    }
+    conv->windowSteps = 0;
+    conv->windows++;
+
+    if (any ? met > 0 : met == CONV_CRITERION_COUNT) {
+        return criterion;
+    }
+    return -1;
+}
+
+#endif
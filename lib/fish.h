@@ -39,21 +39,35 @@ typedef struct Fish
 } Fish;
 
 /**
- * Initializes a fish object with the given position.
+ * Initializes a fish object with the given position and initial weight.
  *
  * @param fish a pointer to the Fish object to be initialized
  * @param position the position of the fish
- *
- * @return void
+ * @param initialWeight the initial weight of the fish
  */
-void fish_init(Fish* fish, Position position) {
+void fish_init_weighted(Fish* fish, Position position, float initialWeight) {
     fish->position = position;
     fish->distanceFromOrigin = position_distance_from_zero(fish->position);
-    fish->initialWeight = rand_float(FISH_INIT_WEIGHT_MIN, FISH_INIT_WEIGHT_MAX);
+    fish->initialWeight = initialWeight;
     fish->weight = fish->initialWeight;
     fish->deltaF = 0.0f;
 }
 
+/**
+ * Initializes a fish object with the given position.
+ *
+ * @param fish a pointer to the Fish object to be initialized
+ * @param position the position of the fish
+ *
+ * @return void
+ */
+void fish_init(Fish* fish, Position position) {
+    fish_init_weighted(
+        fish,
+        position,
+        rand_float(FISH_INIT_WEIGHT_MIN, FISH_INIT_WEIGHT_MAX));
+}
+
 /**
  * @brief Performs a fish's swim in the simulation
  * 
@@ -63,10 +77,12 @@ void fish_init(Fish* fish, Position position) {
  * @param fish the fish that will perofmr a swim
  * @param newPosition the new position of the fish
  * 
- * @return Position the new position of the fish
+ * @return the signed change in distanceFromOrigin, deltaF only keeps the 
+ * magnitude of it
  */
 float fish_swim(Fish* fish, Position newPosition) {
     Position position = fish->position;
+    float signedDeltaF;
 
     fish->position = newPosition;    
 
@@ -80,11 +96,10 @@ float fish_swim(Fish* fish, Position newPosition) {
     // This is because the objective function is the sum of all the distance
     // from origin of all fish in the simulation. If only the difference of one 
     // fish is interested, then the rest will cancel out.
-    fish->deltaF = fabsf(
-        fish->distanceFromOrigin -
-        position_distance_from_zero(position));
+    signedDeltaF = fish->distanceFromOrigin - position_distance_from_zero(position);
+    fish->deltaF = fabsf(signedDeltaF);
 
-    return fish->deltaF;
+    return signedDeltaF;
 }
 
 /**
@@ -94,8 +109,11 @@ float fish_swim(Fish* fish, Position newPosition) {
  *
  * @param fish A pointer to the Fish object.
  * @param maxDeltaF The maximum deltaF of all the fish.
+ *
+ * @return the change in weight of the fish
  */
-void fish_eat(Fish* fish, float maxDeltaF) {
+float fish_eat(Fish* fish, float maxDeltaF) {
+    float oldWeight = fish->weight;
     float newWeight = fish->weight + (fish->deltaF / maxDeltaF);
     fish->weight = min_float(
         max_float(
@@ -104,6 +122,8 @@ void fish_eat(Fish* fish, float maxDeltaF) {
         ),
         fish->initialWeight * FISH_WEIGHT_MAX_SCALE
     );
+
+    return fish->weight - oldWeight;
 }
 
 #endif
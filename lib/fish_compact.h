@@ -0,0 +1,266 @@
+/**
+ * @file fish_compact.h
+ *
+ * Contains the struct definition of type CompactFish, a reduced precision
+ * storage of a Fish using 16 bytes instead of 24, so every sweep over the
+ * fishes moves fewer bytes per fish at the cost of converting the values.
+ *
+ * The position is kept as floats. The initial weight and deltaF are 16 bit
+ * fixed point numbers over their known ranges, the weight gained since is a 32
+ * bit fixed point number and the distance from the origin is recomputed from
+ * the position when needed. The values are converted on load and store by the
+ * functions below.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_FISH_COMPACT
+#define SIM_H_FISH_COMPACT
+
+#include <math.h>
+#include <stdint.h>
+
+#include "fish.h"
+#include "fish_lake.h"
+#include "position.h"
+#include "sim_util.h"
+
+#define COMPACT_FIXED_MAX 65535.0f
+// 31 bits are used of the 32 bit numbers, so a clamped float always converts
+#define COMPACT_FIXED32_MAX 2147483648.0f
+// The initial weight is stored over [FISH_INIT_WEIGHT_MIN, FISH_INIT_WEIGHT_MAX]
+#define COMPACT_INIT_WEIGHT_STEP \
+    ((FISH_INIT_WEIGHT_MAX - FISH_INIT_WEIGHT_MIN) / COMPACT_FIXED_MAX)
+// A fish gains at most its initial weight before it reaches the cap
+#define COMPACT_WEIGHT_GAIN_MAX \
+    (FISH_INIT_WEIGHT_MAX * (FISH_WEIGHT_MAX_SCALE - 1))
+#define COMPACT_WEIGHT_GAIN_STEP (COMPACT_WEIGHT_GAIN_MAX / COMPACT_FIXED32_MAX)
+// deltaF is at most the length of the largest swim in both directions
+#define COMPACT_DELTA_F_MAX (FISH_SWIM_MAX * 1.41421357f)
+
+/**
+ * @brief Represent a fish in the simulation with reduced precision.
+ */
+typedef struct CompactFish
+{
+    Position position;
+    uint16_t initialWeight;
+    uint16_t deltaF;
+    // The weight minus the initial weight
+    uint32_t weightGain;
+} CompactFish;
+
+/**
+ * Converts a value to a 16 bit fixed point number with the given step,
+ * rounding to the nearest and saturating at the limits.
+ *
+ * @param value the value, relative to the minimum of the range
+ * @param step the value of one unit of the fixed point number
+ *
+ * @return the fixed point number
+ */
+uint16_t compact_to_fixed(float value, float step) {
+    float units = value / step + 0.5f;
+    return (uint16_t) min_float(max_float(units, 0.0f), COMPACT_FIXED_MAX);
+}
+
+/**
+ * Converts a value to a 32 bit fixed point number, see compact_to_fixed.
+ *
+ * @param value the value, relative to the minimum of the range
+ * @param step the value of one unit of the fixed point number
+ *
+ * @return the fixed point number
+ */
+uint32_t compact_to_fixed32(float value, float step) {
+    float units = value / step + 0.5f;
+    return (uint32_t) min_float(max_float(units, 0.0f), COMPACT_FIXED32_MAX);
+}
+
+/**
+ * Returns the initial weight of the fish.
+ *
+ * @param fish the fish
+ *
+ * @return the initial weight
+ */
+float compact_fish_initial_weight(const CompactFish* fish) {
+    return FISH_INIT_WEIGHT_MIN
+        + fish->initialWeight * COMPACT_INIT_WEIGHT_STEP;
+}
+
+/**
+ * Returns the weight of the fish.
+ *
+ * @param fish the fish
+ *
+ * @return the weight
+ */
+float compact_fish_weight(const CompactFish* fish) {
+    return compact_fish_initial_weight(fish)
+        + fish->weightGain * COMPACT_WEIGHT_GAIN_STEP;
+}
+
+/**
+ * Returns the deltaF of the fish.
+ *
+ * @param fish the fish
+ *
+ * @return the deltaF
+ */
+float compact_fish_delta_f(const CompactFish* fish) {
+    return fish->deltaF * (COMPACT_DELTA_F_MAX / COMPACT_FIXED_MAX);
+}
+
+/**
+ * Returns the distance of the fish from the origin, derived from its position.
+ *
+ * @param fish the fish
+ *
+ * @return the distance from the origin
+ */
+float compact_fish_distance(const CompactFish* fish) {
+    return position_distance_from_zero(fish->position);
+}
+
+/**
+ * Stores a fish in the compact representation.
+ *
+ * @param compactFish the compact fish to store into
+ * @param fish the fish to store
+ */
+void compact_fish_pack(CompactFish* compactFish, const Fish* fish) {
+    compactFish->position = fish->position;
+    compactFish->initialWeight = compact_to_fixed(
+        fish->initialWeight - FISH_INIT_WEIGHT_MIN,
+        COMPACT_INIT_WEIGHT_STEP);
+    compactFish->weightGain = compact_to_fixed32(
+        fish->weight - compact_fish_initial_weight(compactFish),
+        COMPACT_WEIGHT_GAIN_STEP);
+    compactFish->deltaF = compact_to_fixed(
+        fish->deltaF,
+        COMPACT_DELTA_F_MAX / COMPACT_FIXED_MAX);
+}
+
+/**
+ * Loads a fish from the compact representation.
+ *
+ * @param fish the fish to load into
+ * @param compactFish the compact fish to load
+ */
+void compact_fish_unpack(Fish* fish, const CompactFish* compactFish) {
+    fish->position = compactFish->position;
+    fish->distanceFromOrigin = compact_fish_distance(compactFish);
+    fish->initialWeight = compact_fish_initial_weight(compactFish);
+    fish->weight = compact_fish_weight(compactFish);
+    fish->deltaF = compact_fish_delta_f(compactFish);
+}
+
+/**
+ * Moves a compact fish within the lake, see fish_lake_fish_move.
+ *
+ * @param fishLake a pointer to the FishLake object containing the fish
+ * @param fish a pointer to the compact fish
+ * @param x the amount to move in the x direction
+ * @param y the amount to move in the y direction
+ *
+ * @return The signed change in distance from the origin after the fish swims
+ */
+float compact_fish_lake_move(
+    FishLake* fishLake,
+    CompactFish* fish,
+    float x,
+    float y) {
+    Position position = fish->position;
+    Position newPosition = position;
+    float signedDeltaF;
+
+    position_increment(&newPosition, x, y);
+    fish->position = fish_lake_bound_position(fishLake, position, newPosition);
+
+    signedDeltaF = position_distance_from_zero(fish->position)
+        - position_distance_from_zero(position);
+    fish->deltaF = compact_to_fixed(
+        fabsf(signedDeltaF),
+        COMPACT_DELTA_F_MAX / COMPACT_FIXED_MAX);
+
+    return signedDeltaF;
+}
+
+/**
+ * The compact fish swims a random amount in both directions within the lake,
+ * see fish_lake_fish_swim.
+ *
+ * @param fishLake a pointer to the FishLake object containing the fish
+ * @param fish a pointer to the compact fish
+ * @param seed the seed of the random number generator of the calling thread
+ *
+ * @return The signed change in distance from the origin after the fish swims
+ */
+float compact_fish_lake_swim(
+    FishLake* fishLake,
+    CompactFish* fish,
+    unsigned int * seed) {
+    float x = rand_r_float(seed, FISH_SWIM_MIN, FISH_SWIM_MAX);
+    float y = rand_r_float(seed, FISH_SWIM_MIN, FISH_SWIM_MAX);
+    return compact_fish_lake_move(fishLake, fish, x, y);
+}
+
+/**
+ * Updates the weight of a compact fish, see fish_eat.
+ *
+ * @param fish A pointer to the CompactFish object.
+ * @param maxDeltaF The maximum deltaF of all the fish.
+ *
+ * @return the change in weight of the fish
+ */
+float compact_fish_eat(CompactFish* fish, float maxDeltaF) {
+    float initialWeight = compact_fish_initial_weight(fish);
+    float oldWeight = compact_fish_weight(fish);
+    float newWeight = min_float(
+        max_float(
+            oldWeight + (compact_fish_delta_f(fish) / maxDeltaF),
+            FISH_INIT_WEIGHT_MIN
+        ),
+        initialWeight * FISH_WEIGHT_MAX_SCALE
+    );
+
+    fish->weightGain = compact_to_fixed32(
+        newWeight - initialWeight,
+        COMPACT_WEIGHT_GAIN_STEP);
+
+    return compact_fish_weight(fish) - oldWeight;
+}
+
+/**
+ * Checks the weight range of the compact fishes. A fish of the smallest and of
+ * the largest initial weight is put at the weight cap, packed, fed once more
+ * and unpacked, so both the conversion and compact_fish_eat are covered.
+ *
+ * @return the largest difference from the cap, at most 
+ * COMPACT_INIT_WEIGHT_STEP + COMPACT_WEIGHT_GAIN_STEP if the range holds
+ */
+float compact_fish_cap_error() {
+    const float initialWeights[2] = {FISH_INIT_WEIGHT_MIN, FISH_INIT_WEIGHT_MAX};
+    Position position = {0.0f, 0.0f};
+    float maxError = 0.0f;
+
+    for (int k = 0; k < 2; k++) {
+        Fish fish;
+        CompactFish compactFish;
+        float cap = initialWeights[k] * FISH_WEIGHT_MAX_SCALE;
+
+        fish_init_weighted(&fish, position, initialWeights[k]);
+        fish.weight = cap;
+        fish.deltaF = COMPACT_DELTA_F_MAX;
+        compact_fish_pack(&compactFish, &fish);
+        compact_fish_eat(&compactFish, COMPACT_DELTA_F_MAX);
+        compact_fish_unpack(&fish, &compactFish);
+
+        maxError = max_float(maxError, fabsf(fish.weight - cap));
+    }
+
+    return maxError;
+}
+
+#endif
@@ -15,7 +15,27 @@
 #define FISH_LAKE_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "fish.h"
+#include "arena.h"
+
+#define FISH_LAKE_INIT_SEED_SALT 0x5507ULL
+
+// The boundary policy applied to a move out of the lake, revert unless one of
+// BOUNDARY_CLAMP, BOUNDARY_REFLECT or BOUNDARY_WRAP is defined
+#if defined(BOUNDARY_CLAMP) + defined(BOUNDARY_REFLECT) \
+    + defined(BOUNDARY_WRAP) > 1
+    #error "Only one boundary policy can be defined"
+#elif defined(BOUNDARY_CLAMP)
+    #define FISH_LAKE_BOUNDARY_STR "clamp"
+#elif defined(BOUNDARY_REFLECT)
+    #define FISH_LAKE_BOUNDARY_STR "reflect"
+#elif defined(BOUNDARY_WRAP)
+    #define FISH_LAKE_BOUNDARY_STR "wrap"
+#else
+    #define FISH_LAKE_BOUNDARY_STR "revert"
+#endif
 
 /**
  * @brief Fishlake in the simulation.
@@ -30,6 +50,8 @@ typedef struct FishLake
     float coord_max_y;
     int fish_amount;
     Fish* fishes;
+    // Whether fishes was allocated by malloc and should be freed with the lake
+    int owns_fishes;
 } FishLake;
 
 /**
@@ -51,6 +73,42 @@ FishLake* fish_lake_new(
 
     fishLake->fish_amount = fish_amount;
     fishLake->fishes = (Fish*) malloc(fish_amount * sizeof(Fish));
+    fishLake->owns_fishes = 1;
+    fishLake->coord_min_x = -half_width;
+    fishLake->coord_max_x = half_width;
+    fishLake->coord_min_y = -half_height;
+    fishLake->coord_max_y = half_height;
+
+    return fishLake;
+}
+
+/**
+ * Creates a new instance of FishLake with the fishes allocated from the given
+ * arena. The fishes are aligned to the cache line and are released with the 
+ * arena, not by fish_lake_free.
+ *
+ * @param arena the arena to allocate the fishes from
+ * @param fish_amount the amount of fish in the lake
+ *
+ * @return a pointer to the newly created FishLake instance
+ */
+FishLake* fish_lake_arena_new(
+    Arena* arena,
+    int fish_amount,
+    float width,
+    float height
+    ) {
+    FishLake* fishLake = (FishLake*) malloc(sizeof(FishLake));
+
+    float half_width = width / 2.0f;
+    float half_height = height / 2.0f;
+
+    fishLake->fish_amount = fish_amount;
+    fishLake->fishes = (Fish*) arena_alloc(
+        arena,
+        (size_t) fish_amount * sizeof(Fish),
+        ARENA_MIN_ALIGN);
+    fishLake->owns_fishes = 0;
     fishLake->coord_min_x = -half_width;
     fishLake->coord_max_x = half_width;
     fishLake->coord_min_y = -half_height;
@@ -84,45 +142,224 @@ void fish_lake_init_fishes(FishLake* fishLake) {
     }
 }
 
+/**
+ * Initialises the fishes of the lake in parallel from the counter based random
+ * streams, one stream per fish keyed by its global id. Every fish gets the
+ * same values no matter which process or thread initialises it, so each 
+ * process can initialise its own part of the school. The threads touch the 
+ * fishes in the same static schedule as the simulation passes.
+ *
+ * @param fishLake the pointer to the FishLake object
+ * @param seed the seed of the school
+ * @param idOffset the global id of the first fish of this lake
+ */
+void fish_lake_init_fishes_seeded(
+    FishLake* fishLake,
+    unsigned int seed,
+    int idOffset) {
+    // Keeps the initialisation streams apart from the swim streams
+    uint64_t initSeed = rand_hash(seed ^ FISH_LAKE_INIT_SEED_SALT);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < fishLake->fish_amount; i++) {
+        uint64_t id = (uint64_t) (idOffset + i);
+        Position pos = {
+            rand_hash_float(initSeed, id, 0,
+                fishLake->coord_min_x, fishLake->coord_max_x),
+            rand_hash_float(initSeed, id, 1,
+                fishLake->coord_min_y, fishLake->coord_max_y)};
+
+        fish_init_weighted(
+            &(fishLake->fishes[i]),
+            pos,
+            rand_hash_float(initSeed, id, 2,
+                FISH_INIT_WEIGHT_MIN, FISH_INIT_WEIGHT_MAX));
+    }
+}
+
+/**
+ * Finds the lightest and the heaviest fish of the lake, the first one of the
+ * fishes with the same weight.
+ *
+ * @param fishLake a pointer to the FishLake object
+ * @param lightest receives the index of the lightest fish, -1 if empty
+ * @param heaviest receives the index of the heaviest fish, -1 if empty
+ */
+void fish_lake_weight_extremes(
+    const FishLake* fishLake,
+    int* lightest,
+    int* heaviest) {
+    *lightest = -1;
+    *heaviest = -1;
+
+    #pragma omp parallel
+    {
+        int threadLightest = -1;
+        int threadHeaviest = -1;
+
+        #pragma omp for schedule(static) nowait
+        for (int i = 0; i < fishLake->fish_amount; i++) {
+            float weight = fishLake->fishes[i].weight;
+
+            if (threadLightest < 0
+                || weight < fishLake->fishes[threadLightest].weight) {
+                threadLightest = i;
+            }
+            if (threadHeaviest < 0
+                || weight > fishLake->fishes[threadHeaviest].weight) {
+                threadHeaviest = i;
+            }
+        }
+
+        #pragma omp critical
+        {
+            if (threadLightest >= 0 && (*lightest < 0
+                || fishLake->fishes[threadLightest].weight
+                    < fishLake->fishes[*lightest].weight
+                || (fishLake->fishes[threadLightest].weight
+                    == fishLake->fishes[*lightest].weight
+                    && threadLightest < *lightest))) {
+                *lightest = threadLightest;
+            }
+            if (threadHeaviest >= 0 && (*heaviest < 0
+                || fishLake->fishes[threadHeaviest].weight
+                    > fishLake->fishes[*heaviest].weight
+                || (fishLake->fishes[threadHeaviest].weight
+                    == fishLake->fishes[*heaviest].weight
+                    && threadHeaviest < *heaviest))) {
+                *heaviest = threadHeaviest;
+            }
+        }
+    }
+}
+
 /**
  * Frees the memory allocated for a FishLake object.
  *
  * @param fishLake the pointer to the FishLake object to be freed
  */
 void fish_lake_free(FishLake* fishLake) {
-    free(fishLake->fishes);
+    if (fishLake->owns_fishes) {
+        free(fishLake->fishes);
+    }
     free(fishLake);
 }
 
 /**
- * The fish lake responsible for controlling how a fish swims in the lake. The 
- * new position of the fish will be checked against the boundaries. If one of 
- * the coordinate is outside the boundaries, the position will be set to the 
- * coordinates of the old position.
+ * Bounds a coordinate of a move to the lake by the boundary policy chosen at
+ * compile time. Every policy is free of branches, so a fish near a wall costs
+ * no mispredicted branch and the swim loop can be vectorised.
+ *
+ * @param coord the coordinate before the move
+ * @param newCoord the coordinate after the move
+ * @param min the lower wall
+ * @param max the upper wall
+ *
+ * @return the coordinate within the lake
+ */
+float fish_lake_bound_coord(float coord, float newCoord, float min, float max) {
+#if defined(BOUNDARY_CLAMP) || defined(BOUNDARY_REFLECT) \
+    || defined(BOUNDARY_WRAP)
+    // Only the revert policy goes back to the old coordinate
+    (void) coord;
+#endif
+#if defined(BOUNDARY_CLAMP)
+    // Stops at the wall, a max and a min instruction
+    return min_float(max_float(newCoord, min), max);
+#elif defined(BOUNDARY_REFLECT)
+    // Bounces back by the amount the move went past the wall, each comparison
+    // is 0 or 1. A move is far shorter than the lake, so it never bounces off
+    // both walls. Adding 0 keeps a coordinate within the lake exact.
+    newCoord += (float) (newCoord > max) * (2.0f * (max - newCoord));
+    return newCoord + (float) (newCoord < min) * (2.0f * (min - newCoord));
+#elif defined(BOUNDARY_WRAP)
+    // Comes back in from the opposite wall
+    return newCoord
+        + (max - min) * (float) ((newCoord < min) - (newCoord > max));
+#else
+    // Reverts the move by blending the bits of the two coordinates with a
+    // mask of the comparisons, & evaluates both without a branch
+    uint32_t inside = (newCoord >= min) & (newCoord <= max);
+    uint32_t mask = 0u - inside;
+    uint32_t oldBits;
+    uint32_t newBits;
+
+    memcpy(&oldBits, &coord, sizeof(float));
+    memcpy(&newBits, &newCoord, sizeof(float));
+    newBits = (newBits & mask) | (oldBits & ~mask);
+    memcpy(&newCoord, &newBits, sizeof(float));
+
+    return newCoord;
+#endif
+}
+
+/**
+ * Bounds the new position of a fish to the lake, see fish_lake_bound_coord.
+ * With the default revert policy a coordinate outside the boundaries is set
+ * to the coordinate of the old position.
+ *
+ * @param fishLake a pointer to the FishLake object
+ * @param position the position before the move
+ * @param newPosition the position after the move
+ *
+ * @return the position within the lake
+ */
+Position fish_lake_bound_position(
+    FishLake* fishLake,
+    Position position,
+    Position newPosition) {
+    newPosition.x = fish_lake_bound_coord(
+        position.x,
+        newPosition.x,
+        fishLake->coord_min_x,
+        fishLake->coord_max_x);
+    newPosition.y = fish_lake_bound_coord(
+        position.y,
+        newPosition.y,
+        fishLake->coord_min_y,
+        fishLake->coord_max_y);
+
+    return newPosition;
+}
+
+/**
+ * The fish lake responsible for controlling how a fish moves in the lake. The 
+ * new position of the fish will be checked against the boundaries and bounded
+ * by the boundary policy, see fish_lake_bound_coord.
  *
  * @param fishLake a pointer to the FishLake object containing the fish
  * @param fish a pointer to the fish
+ * @param x the amount to move in the x direction
+ * @param y the amount to move in the y direction
  *
- * @return The deltaF produced after the fish swims
+ * @return The signed change in distance from the origin after the fish swims,
+ * the fish's deltaF is the magnitude of it
  */
-float fish_lake_fish_swim(FishLake* fishLake, Fish* fish, unsigned int * seed) {
+float fish_lake_fish_move(FishLake* fishLake, Fish* fish, float x, float y) {
     Position position = fish->position;
     Position newPosition = position;
-    position_increment(
-        &newPosition, 
-        rand_r_float(seed, FISH_SWIM_MIN, FISH_SWIM_MAX), 
-        rand_r_float(seed, FISH_SWIM_MIN, FISH_SWIM_MAX)
-    );
-
-    if (!f_is_between(newPosition.x, fishLake->coord_min_x, fishLake->coord_max_x)) {
-        newPosition.x = position.x;
-    }
+    position_increment(&newPosition, x, y);
 
-    if (!f_is_between(newPosition.y, fishLake->coord_min_y, fishLake->coord_max_y)) {
-        newPosition.y = position.y;
-    }
+    return fish_swim(
+        fish,
+        fish_lake_bound_position(fishLake, position, newPosition));
+}
 
-    return fish_swim(fish, newPosition);
+/**
+ * The fish swims a random amount in both directions within the lake, see
+ * fish_lake_fish_move.
+ *
+ * @param fishLake a pointer to the FishLake object containing the fish
+ * @param fish a pointer to the fish
+ * @param seed the seed of the random number generator of the calling thread
+ *
+ * @return The signed change in distance from the origin after the fish swims,
+ * the fish's deltaF is the magnitude of it
+ */
+float fish_lake_fish_swim(FishLake* fishLake, Fish* fish, unsigned int * seed) {
+    float x = rand_r_float(seed, FISH_SWIM_MIN, FISH_SWIM_MAX);
+    float y = rand_r_float(seed, FISH_SWIM_MIN, FISH_SWIM_MAX);
+    return fish_lake_fish_move(fishLake, fish, x, y);
 }
 
 #endif
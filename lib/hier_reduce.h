@@ -0,0 +1,248 @@
+/**
+ * @file hier_reduce.h
+ *
+ * Contains a two level, node aware, allreduce. The ranks sharing a node
+ * combine their values through a MPI shared memory window, only one leader
+ * per node takes part in the inter-node MPI_Allreduce and the result is handed
+ * back to the rest of the node through the same window.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_HIER_REDUCE
+#define SIM_H_HIER_REDUCE
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_util.h"
+
+// The maximum amount of floats that can be reduced in a single call. Each rank
+// owns a slot of this size in the shared window.
+#define HIER_REDUCE_MAX_COUNT 8
+#define HIER_REDUCE_LEADER 0
+
+/**
+ * @brief State of the node aware reduction.
+ *
+ * The shared window is laid out as one slot per rank on the node, followed by
+ * one extra slot holding the reduced result.
+ */
+typedef struct HierReduce
+{
+    // The communicator the reductions are performed over, owned by the caller
+    MPI_Comm comm;
+    // Communicator of the ranks sharing the same node
+    MPI_Comm nodeComm;
+    // Communicator of the node leaders, MPI_COMM_NULL on the other ranks
+    MPI_Comm leaderComm;
+    // The shared memory window, allocated by the node leader
+    MPI_Win win;
+    // Base of the shared memory window, same memory on all ranks of the node
+    float* shared;
+    // The rank within the node
+    int nodeRank;
+    // The number of ranks on this node
+    int nodeSize;
+    // The number of nodes, or leaders, taking part in the reduction
+    int nodeCount;
+} HierReduce;
+
+/**
+ * Creates the node and leader communicators and the shared memory window used
+ * by hier_reduce_allreduce. This is collective over comm.
+ *
+ * @param comm the communicator to perform reductions over
+ *
+ * @return a pointer to the newly created HierReduce
+ */
+HierReduce* hier_reduce_new(MPI_Comm comm) {
+    HierReduce* hierReduce = (HierReduce*) malloc(sizeof(HierReduce));
+    int rank;
+    MPI_Aint windowSize;
+    MPI_Aint querySize;
+    int dispUnit;
+
+    hierReduce->comm = comm;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(
+        comm,
+        MPI_COMM_TYPE_SHARED,
+        rank,
+        MPI_INFO_NULL,
+        &hierReduce->nodeComm);
+    MPI_Comm_rank(hierReduce->nodeComm, &hierReduce->nodeRank);
+    MPI_Comm_size(hierReduce->nodeComm, &hierReduce->nodeSize);
+
+    // Only the leader of each node joins the inter-node communicator
+    MPI_Comm_split(
+        comm,
+        hierReduce->nodeRank == HIER_REDUCE_LEADER ? 0 : MPI_UNDEFINED,
+        rank,
+        &hierReduce->leaderComm);
+
+    if (hierReduce->leaderComm != MPI_COMM_NULL) {
+        MPI_Comm_size(hierReduce->leaderComm, &hierReduce->nodeCount);
+    }
+    MPI_Bcast(
+        &hierReduce->nodeCount,
+        1,
+        MPI_INT,
+        HIER_REDUCE_LEADER,
+        hierReduce->nodeComm);
+
+    // The leader allocates the whole segment so it is contiguous, the others
+    // attach with a size of zero and query the base address of the leader.
+    windowSize = hierReduce->nodeRank == HIER_REDUCE_LEADER
+        ? (MPI_Aint) (hierReduce->nodeSize + 1) * HIER_REDUCE_MAX_COUNT
+            * sizeof(float)
+        : 0;
+    MPI_Win_allocate_shared(
+        windowSize,
+        sizeof(float),
+        MPI_INFO_NULL,
+        hierReduce->nodeComm,
+        &hierReduce->shared,
+        &hierReduce->win);
+    MPI_Win_shared_query(
+        hierReduce->win,
+        HIER_REDUCE_LEADER,
+        &querySize,
+        &dispUnit,
+        &hierReduce->shared);
+
+    // A single passive epoch is kept open for the lifetime of the window,
+    // ordering is done with MPI_Win_sync and barriers on the node.
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, hierReduce->win);
+
+    return hierReduce;
+}
+
+/**
+ * Tells whether the node level combine supports the operation.
+ *
+ * @param op the reduction operation
+ *
+ * @return 1 for MPI_SUM, MPI_MAX and MPI_MIN, 0 otherwise
+ */
+int hier_reduce_supports(MPI_Op op) {
+    return op == MPI_SUM || op == MPI_MAX || op == MPI_MIN;
+}
+
+/**
+ * Combines count floats of src into dst using the given operation. Only
+ * MPI_SUM, MPI_MAX and MPI_MIN are supported, any other operation aborts.
+ *
+ * @param dst the values to be combined into
+ * @param src the values to combine
+ * @param count the amount of values
+ * @param op the reduction operation
+ */
+void hier_reduce_combine(float* dst, const float* src, int count, MPI_Op op) {
+    if (!hier_reduce_supports(op)) {
+        fprintf(stderr, "hier_reduce_combine: unsupported operation\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (op == MPI_SUM) {
+            dst[i] += src[i];
+        } else if (op == MPI_MAX) {
+            dst[i] = max_float(dst[i], src[i]);
+        } else if (op == MPI_MIN) {
+            dst[i] = min_float(dst[i], src[i]);
+        }
+    }
+}
+
+/**
+ * Performs an allreduce of count floats with the same result as
+ * MPI_Allreduce over the communicator given to hier_reduce_new. This is
+ * collective over that communicator.
+ *
+ * @param hierReduce the node aware reduction state
+ * @param sendBuf the local values
+ * @param recvBuf receives the reduced values
+ * @param count the amount of values, more than HIER_REDUCE_MAX_COUNT do not fit
+ * in the slots and are reduced with a flat MPI_Allreduce instead
+ * @param op the reduction operation, any operation other than MPI_SUM, MPI_MAX
+ * or MPI_MIN is also reduced with a flat MPI_Allreduce
+ */
+void hier_reduce_allreduce(
+    HierReduce* hierReduce,
+    const float* sendBuf,
+    float* recvBuf,
+    int count,
+    MPI_Op op) {
+    float* slot = hierReduce->shared + hierReduce->nodeRank
+        * HIER_REDUCE_MAX_COUNT;
+    float* result = hierReduce->shared + hierReduce->nodeSize
+        * HIER_REDUCE_MAX_COUNT;
+
+    if (count > HIER_REDUCE_MAX_COUNT || !hier_reduce_supports(op)) {
+        MPI_Allreduce(sendBuf, recvBuf, count, MPI_FLOAT, op,
+            hierReduce->comm);
+        return;
+    }
+
+    memcpy(slot, sendBuf, count * sizeof(float));
+
+    // Make the slot visible to the leader before it starts combining
+    MPI_Win_sync(hierReduce->win);
+    MPI_Barrier(hierReduce->nodeComm);
+    MPI_Win_sync(hierReduce->win);
+
+    if (hierReduce->nodeRank == HIER_REDUCE_LEADER) {
+        float nodeVals[HIER_REDUCE_MAX_COUNT];
+
+        memcpy(nodeVals, hierReduce->shared, count * sizeof(float));
+        for (int i = 1; i < hierReduce->nodeSize; i++) {
+            hier_reduce_combine(
+                nodeVals,
+                hierReduce->shared + i * HIER_REDUCE_MAX_COUNT,
+                count,
+                op);
+        }
+
+        // A single node does not need to go through MPI at all
+        if (hierReduce->nodeCount > 1) {
+            MPI_Allreduce(
+                nodeVals,
+                result,
+                count,
+                MPI_FLOAT,
+                op,
+                hierReduce->leaderComm);
+        } else {
+            memcpy(result, nodeVals, count * sizeof(float));
+        }
+        MPI_Win_sync(hierReduce->win);
+    }
+
+    // The second barrier also guarantees that the leader has read every slot
+    // before any rank overwrites its slot in the next call.
+    MPI_Barrier(hierReduce->nodeComm);
+    MPI_Win_sync(hierReduce->win);
+
+    memcpy(recvBuf, result, count * sizeof(float));
+}
+
+/**
+ * Frees the window, the communicators and the HierReduce itself. This is
+ * collective over the communicator given to hier_reduce_new.
+ *
+ * @param hierReduce the node aware reduction state to be freed
+ */
+void hier_reduce_free(HierReduce* hierReduce) {
+    MPI_Win_unlock_all(hierReduce->win);
+    MPI_Win_free(&hierReduce->win);
+    if (hierReduce->leaderComm != MPI_COMM_NULL) {
+        MPI_Comm_free(&hierReduce->leaderComm);
+    }
+    MPI_Comm_free(&hierReduce->nodeComm);
+    free(hierReduce);
+}
+
+#endif
@@ -0,0 +1,439 @@
+/**
+ * @file island_model.h
+ *
+ * Contains the island model of the simulation. The school is split into many
+ * smaller lakes that evolve independently, each with its own barycentre, and
+ * every few steps the heaviest fish of every lake migrates to the next lake in
+ * a ring, replacing the lightest fish there.
+ *
+ * With at least as many lakes as processes, every process holds whole lakes
+ * and the steps need no communication at all. With fewer lakes, the processes
+ * are split into a sub-communicator per lake and the reductions of a lake only
+ * span the processes of that lake. The migration is the only communication
+ * between the lakes, a single MPI_Sendrecv with the neighbouring processes.
+ *
+ * Every fish swims from its own counter based random stream keyed by its
+ * global id, so a run only depends on the seed and the amount of lakes.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_ISLAND_MODEL
+#define SIM_H_ISLAND_MODEL
+
+#include <float.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <mpi.h>
+#include <omp.h>
+
+#include "fish.h"
+#include "fish_lake.h"
+#include "arena.h"
+#include "sim_util.h"
+#include "work_parition.h"
+
+/**
+ * @brief The lakes held by a process and their place in the ring of lakes.
+ */
+typedef struct IslandModel
+{
+    // The lakes of this process, a slice of the lake when a lake is shared
+    FishLake** lakes;
+    int lakeCount;
+    int totalLakes;
+    // The global index of the first lake of this process
+    int lakeOffset;
+    // The global id of the first fish of every lake of this process
+    int* fishIdOffsets;
+    // The barycentre of every lake of this process in the last step
+    float* barycentres;
+    // The processes sharing the lakes of this process, MPI_COMM_SELF when
+    // every lake is held by a single process
+    MPI_Comm lakeComm;
+    int groupSize;
+    int groupRank;
+    // Whether every lake is stepped by a single thread, so it stays in the
+    // cache of that thread for the whole step
+    int lakePerThread;
+    // The processes the emigrants are sent to and received from
+    int nextRank;
+    int prevRank;
+    // The emigrant and the index of the lightest fish of every lake, -1 when
+    // the lightest fish is held by another process of the lake
+    Fish* emigrants;
+    int* lightest;
+    int migrations;
+} IslandModel;
+
+/**
+ * Adds the sums of the barycentre of the fishes in [begin, end) of the lake.
+ *
+ * @param fishLake the lake
+ * @param begin the first fish
+ * @param end one past the last fish
+ * @param sums the sum of dfo * weight and the sum of dfo, added to
+ */
+void island_lake_sums(
+    const FishLake* fishLake,
+    int begin,
+    int end,
+    float sums[2]) {
+    for (int i = begin; i < end; i++) {
+        float distance = fishLake->fishes[i].distanceFromOrigin;
+
+        sums[0] += distance * fishLake->fishes[i].weight;
+        sums[1] += distance;
+    }
+}
+
+/**
+ * Swims the fishes in [begin, end) of the lake, two draws per fish per step
+ * from the stream of the fish.
+ *
+ * @param fishLake the lake
+ * @param begin the first fish
+ * @param end one past the last fish
+ * @param seed the seed of the per fish random streams
+ * @param idOffset the global id of the first fish of the lake
+ * @param step the step, the position in the random streams
+ *
+ * @return the max deltaF of the fishes
+ */
+float island_lake_swim(
+    FishLake* fishLake,
+    int begin,
+    int end,
+    uint64_t seed,
+    int idOffset,
+    int step) {
+    float maxDeltaF = 0.0f;
+
+    for (int i = begin; i < end; i++) {
+        Fish* fish = &(fishLake->fishes[i]);
+
+        fish_lake_fish_move(
+            fishLake,
+            fish,
+            rand_hash_float(seed, idOffset + i, 2 * step,
+                FISH_SWIM_MIN, FISH_SWIM_MAX),
+            rand_hash_float(seed, idOffset + i, 2 * step + 1,
+                FISH_SWIM_MIN, FISH_SWIM_MAX));
+        maxDeltaF = max_float(maxDeltaF, fish->deltaF);
+    }
+
+    return maxDeltaF;
+}
+
+/**
+ * Feeds the fishes in [begin, end) of the lake.
+ *
+ * @param fishLake the lake
+ * @param begin the first fish
+ * @param end one past the last fish
+ * @param maxDeltaF the max deltaF of the lake
+ */
+void island_lake_eat(FishLake* fishLake, int begin, int end, float maxDeltaF) {
+    for (int i = begin; i < end; i++) {
+        fish_eat(&(fishLake->fishes[i]), maxDeltaF);
+    }
+}
+
+/**
+ * Creates the lakes of this process and initialises their fishes. The fishes
+ * are split evenly over the lakes and the lakes evenly over the processes,
+ * and with fewer lakes than processes every lake is shared by the same amount
+ * of processes. Collective over the communicator.
+ *
+ * @param arena the arena the fishes are allocated from
+ * @param comm the communicator
+ * @param fishAmount the amount of fishes of every lake together
+ * @param totalLakes the amount of lakes
+ * @param width the width of every lake
+ * @param height the height of every lake
+ * @param seed the seed of the school
+ *
+ * @return a pointer to the newly created IslandModel, NULL if the processes
+ * cannot be split evenly over the lakes
+ */
+IslandModel* island_model_new(
+    Arena* arena,
+    MPI_Comm comm,
+    int fishAmount,
+    int totalLakes,
+    float width,
+    float height,
+    unsigned int seed) {
+    IslandModel* model;
+    WorkPartition* fishPartition;
+    int rank;
+    int size;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (totalLakes < 1 || fishAmount < totalLakes
+        || (totalLakes < size && size % totalLakes != 0)) {
+        return NULL;
+    }
+
+    model = (IslandModel*) malloc(sizeof(IslandModel));
+    model->totalLakes = totalLakes;
+    model->migrations = 0;
+
+    if (totalLakes >= size) {
+        WorkPartition* lakePartition = work_parition_new(size, totalLakes, rank);
+
+        model->lakeCount = lakePartition->size;
+        model->lakeOffset = lakePartition->offset;
+        model->lakeComm = MPI_COMM_SELF;
+        model->groupSize = 1;
+        model->groupRank = 0;
+        work_parition_free(lakePartition);
+    } else {
+        model->lakeCount = 1;
+        model->groupSize = size / totalLakes;
+        model->lakeOffset = rank / model->groupSize;
+        MPI_Comm_split(comm, model->lakeOffset, rank, &model->lakeComm);
+        MPI_Comm_rank(model->lakeComm, &model->groupRank);
+    }
+
+    model->lakePerThread = model->groupSize == 1
+        && model->lakeCount >= omp_get_max_threads();
+    // The same process of the next lake holds the first fishes of it
+    model->nextRank = (rank + model->groupSize) % size;
+    model->prevRank = (rank - model->groupSize + size) % size;
+
+    model->lakes = (FishLake**) malloc(model->lakeCount * sizeof(FishLake*));
+    model->fishIdOffsets = (int*) malloc(model->lakeCount * sizeof(int));
+    model->barycentres = (float*) malloc(model->lakeCount * sizeof(float));
+    model->emigrants = (Fish*) malloc(model->lakeCount * sizeof(Fish));
+    model->lightest = (int*) malloc(model->lakeCount * sizeof(int));
+
+    fishPartition = work_parition_new(totalLakes, fishAmount, 0);
+    for (int l = 0; l < model->lakeCount; l++) {
+        int lake = model->lakeOffset + l;
+        WorkPartition* slice = work_parition_new(
+            model->groupSize,
+            fishPartition->sizes[lake],
+            model->groupRank);
+
+        model->lakes[l] = fish_lake_arena_new(
+            arena,
+            slice->size,
+            width,
+            height);
+        model->fishIdOffsets[l] = fishPartition->offsets[lake] + slice->offset;
+        model->barycentres[l] = 0.0f;
+        work_parition_free(slice);
+    }
+    work_parition_free(fishPartition);
+
+    // The fishes are first touched by the thread that steps them
+    if (model->lakePerThread) {
+        #pragma omp parallel for schedule(static)
+        for (int l = 0; l < model->lakeCount; l++) {
+            fish_lake_init_fishes_seeded(
+                model->lakes[l],
+                seed,
+                model->fishIdOffsets[l]);
+        }
+    } else {
+        for (int l = 0; l < model->lakeCount; l++) {
+            fish_lake_init_fishes_seeded(
+                model->lakes[l],
+                seed,
+                model->fishIdOffsets[l]);
+        }
+    }
+
+    return model;
+}
+
+/**
+ * Runs a step of a lake with every thread, each one taking a static range of
+ * the fishes. The reductions span the processes sharing the lake.
+ *
+ * @param model the island model
+ * @param l the lake of this process
+ * @param seed the seed of the per fish random streams
+ * @param step the step
+ */
+void island_model_step_shared(
+    IslandModel* model,
+    int l,
+    uint64_t seed,
+    int step) {
+    FishLake* fishLake = model->lakes[l];
+    float sumOfDistWeight = 0.0f;
+    float objectiveValue = 0.0f;
+    float maxDeltaF = 0.0f;
+    float sums[2];
+
+    #pragma omp parallel reduction(+: sumOfDistWeight, objectiveValue) \
+        reduction(max: maxDeltaF)
+    {
+        int threads = omp_get_num_threads();
+        int thread = omp_get_thread_num();
+        int begin = (int) ((long) fishLake->fish_amount * thread / threads);
+        int end = (int) ((long) fishLake->fish_amount * (thread + 1) / threads);
+        float threadSums[2] = {0.0f, 0.0f};
+
+        island_lake_sums(fishLake, begin, end, threadSums);
+        sumOfDistWeight += threadSums[0];
+        objectiveValue += threadSums[1];
+
+        // Every thread only swims its own fishes, already summed above
+        maxDeltaF = island_lake_swim(fishLake, begin, end, seed,
+            model->fishIdOffsets[l], step);
+    }
+
+    sums[0] = sumOfDistWeight;
+    sums[1] = objectiveValue;
+    if (model->groupSize > 1) {
+        MPI_Allreduce(MPI_IN_PLACE, sums, 2, MPI_FLOAT, MPI_SUM,
+            model->lakeComm);
+        MPI_Allreduce(MPI_IN_PLACE, &maxDeltaF, 1, MPI_FLOAT, MPI_MAX,
+            model->lakeComm);
+    }
+    model->barycentres[l] = sums[0] / sums[1];
+
+    #pragma omp parallel
+    {
+        int threads = omp_get_num_threads();
+        int thread = omp_get_thread_num();
+        int begin = (int) ((long) fishLake->fish_amount * thread / threads);
+        int end = (int) ((long) fishLake->fish_amount * (thread + 1) / threads);
+
+        island_lake_eat(fishLake, begin, end, maxDeltaF);
+    }
+}
+
+/**
+ * Runs a step of every lake of this process. With a lake per thread every
+ * lake is stepped start to end by one thread, otherwise the lakes are stepped
+ * one after the other by every thread. Collective over the processes of a
+ * lake.
+ *
+ * @param model the island model
+ * @param seed the seed of the per fish random streams
+ * @param step the step
+ */
+void island_model_step(IslandModel* model, uint64_t seed, int step) {
+    if (model->lakePerThread) {
+        #pragma omp parallel for schedule(static)
+        for (int l = 0; l < model->lakeCount; l++) {
+            FishLake* fishLake = model->lakes[l];
+            float sums[2] = {0.0f, 0.0f};
+            float maxDeltaF;
+
+            island_lake_sums(fishLake, 0, fishLake->fish_amount, sums);
+            model->barycentres[l] = sums[0] / sums[1];
+            maxDeltaF = island_lake_swim(fishLake, 0, fishLake->fish_amount,
+                seed, model->fishIdOffsets[l], step);
+            island_lake_eat(fishLake, 0, fishLake->fish_amount, maxDeltaF);
+        }
+    } else {
+        for (int l = 0; l < model->lakeCount; l++) {
+            island_model_step_shared(model, l, seed, step);
+        }
+    }
+}
+
+/**
+ * Migrates the heaviest fish of every lake to the next lake in the ring, where
+ * it replaces the lightest fish. The last lake sends to the first one. A
+ * single lake has no other lake to migrate to, so nothing is done and no
+ * process communicates. Collective over the communicator otherwise.
+ *
+ * @param model the island model
+ * @param fishType the MPI datatype of a fish
+ * @param comm the communicator the model was created with
+ */
+void island_model_migrate(
+    IslandModel* model,
+    MPI_Datatype fishType,
+    MPI_Comm comm) {
+    Fish immigrant;
+    int last = model->lakeCount - 1;
+
+    if (model->totalLakes == 1) {
+        return;
+    }
+
+    // The emigrant is found within the lake first, with a lake per thread the
+    // search of every lake runs on a single thread
+    #pragma omp parallel for schedule(static) if(model->lakePerThread)
+    for (int l = 0; l < model->lakeCount; l++) {
+        FishLake* fishLake = model->lakes[l];
+        int heaviest;
+
+        fish_lake_weight_extremes(fishLake, &(model->lightest[l]), &heaviest);
+        if (heaviest >= 0) {
+            model->emigrants[l] = fishLake->fishes[heaviest];
+        }
+    }
+
+    // A shared lake takes the heaviest and the lightest of its processes
+    for (int l = 0; l < model->lakeCount && model->groupSize > 1; l++) {
+        FishLake* fishLake = model->lakes[l];
+        // The weight and the rank of the process holding the fish
+        struct { float weight; int rank; } local, found;
+
+        // An empty slice takes no part in either search
+        local.weight = fishLake->fish_amount > 0
+            ? model->emigrants[l].weight
+            : -FLT_MAX;
+        local.rank = model->groupRank;
+        MPI_Allreduce(&local, &found, 1, MPI_FLOAT_INT, MPI_MAXLOC,
+            model->lakeComm);
+        MPI_Bcast(&(model->emigrants[l]), 1, fishType, found.rank,
+            model->lakeComm);
+
+        local.weight = model->lightest[l] >= 0
+            ? fishLake->fishes[model->lightest[l]].weight
+            : FLT_MAX;
+        MPI_Allreduce(&local, &found, 1, MPI_FLOAT_INT, MPI_MINLOC,
+            model->lakeComm);
+        if (found.rank != model->groupRank) {
+            model->lightest[l] = -1;
+        }
+    }
+
+    MPI_Sendrecv(
+        &(model->emigrants[last]), 1, fishType, model->nextRank, 0,
+        &immigrant, 1, fishType, model->prevRank, 0,
+        comm, MPI_STATUS_IGNORE);
+
+    for (int l = 0; l < model->lakeCount; l++) {
+        if (model->lightest[l] >= 0) {
+            model->lakes[l]->fishes[model->lightest[l]] = l > 0
+                ? model->emigrants[l - 1]
+                : immigrant;
+        }
+    }
+    model->migrations++;
+}
+
+/**
+ * Frees the island model and its lakes, the fishes are released with the
+ * arena.
+ *
+ * @param model the island model to be freed
+ */
+void island_model_free(IslandModel* model) {
+    for (int l = 0; l < model->lakeCount; l++) {
+        fish_lake_free(model->lakes[l]);
+    }
+    if (model->groupSize > 1) {
+        MPI_Comm_free(&model->lakeComm);
+    }
+    free(model->lakes);
+    free(model->fishIdOffsets);
+    free(model->barycentres);
+    free(model->emigrants);
+    free(model->lightest);
+    free(model);
+}
+
+#endif
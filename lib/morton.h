@@ -0,0 +1,259 @@
+/**
+ * @file morton.h
+ *
+ * Contains the reordering of fishes by the Z-order (Morton) curve of their
+ * position, so that fishes close in the lake are also close in memory. The
+ * fishes are sorted with a parallel LSD radix sort on a 32 bit key, 16 bits
+ * per coordinate, and carry their original id so the original order can be
+ * restored for the output.
+ *
+ * Every buffer is allocated from the arena when the sorter is created, so
+ * sorting inside the simulation steps does not allocate.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_MORTON
+#define SIM_H_MORTON
+
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+
+#include "fish.h"
+#include "fish_lake.h"
+#include "arena.h"
+
+#define MORTON_RADIX_BITS 8
+#define MORTON_RADIX_SIZE (1 << MORTON_RADIX_BITS)
+#define MORTON_KEY_BITS 32
+
+/**
+ * @brief The scratch buffers used to sort the fishes of a lake.
+ *
+ * The buffers are swapped with the sorted ones after every sort, the fishes
+ * and ids given to the sorter may point to either.
+ */
+typedef struct MortonSorter
+{
+    int fishAmount;
+    int threadCount;
+    uint32_t* keys;
+    uint32_t* keysTmp;
+    // The index of the fish each key belongs to
+    uint32_t* perm;
+    uint32_t* permTmp;
+    Fish* fishesTmp;
+    int* idsTmp;
+    // One histogram of the digits per thread
+    int* histograms;
+} MortonSorter;
+
+/**
+ * Spreads the lower 16 bits of the value to the even bits.
+ *
+ * @param value the value to spread
+ *
+ * @return the spread value
+ */
+uint32_t morton_spread(uint32_t value) {
+    value &= 0x0000FFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+/**
+ * Calculates the Morton key of a position in the lake. Each coordinate is
+ * quantised to 16 bits over the bounds of the lake and the bits are
+ * interleaved, x in the even bits and y in the odd bits.
+ *
+ * @param fishLake the lake giving the bounds
+ * @param position the position
+ *
+ * @return the Morton key
+ */
+uint32_t morton_key(const FishLake* fishLake, Position position) {
+    float scaleX = 65535.0f / (fishLake->coord_max_x - fishLake->coord_min_x);
+    float scaleY = 65535.0f / (fishLake->coord_max_y - fishLake->coord_min_y);
+    uint32_t x = (uint32_t) ((position.x - fishLake->coord_min_x) * scaleX);
+    uint32_t y = (uint32_t) ((position.y - fishLake->coord_min_y) * scaleY);
+
+    return morton_spread(x) | (morton_spread(y) << 1);
+}
+
+/**
+ * Creates a new MortonSorter with the buffers allocated from the arena.
+ *
+ * @param arena the arena to allocate from
+ * @param fishAmount the amount of fishes to be sorted
+ *
+ * @return a pointer to the newly created MortonSorter
+ */
+MortonSorter* morton_sorter_new(Arena* arena, int fishAmount) {
+    MortonSorter* sorter = (MortonSorter*) malloc(sizeof(MortonSorter));
+    size_t keyBytes = (size_t) fishAmount * sizeof(uint32_t);
+
+    sorter->fishAmount = fishAmount;
+    sorter->threadCount = omp_get_max_threads();
+    sorter->keys = (uint32_t*) arena_alloc(arena, keyBytes, ARENA_MIN_ALIGN);
+    sorter->keysTmp = (uint32_t*) arena_alloc(arena, keyBytes, ARENA_MIN_ALIGN);
+    sorter->perm = (uint32_t*) arena_alloc(arena, keyBytes, ARENA_MIN_ALIGN);
+    sorter->permTmp = (uint32_t*) arena_alloc(arena, keyBytes, ARENA_MIN_ALIGN);
+    sorter->fishesTmp = (Fish*) arena_alloc(
+        arena,
+        (size_t) fishAmount * sizeof(Fish),
+        ARENA_MIN_ALIGN);
+    sorter->idsTmp = (int*) arena_alloc(
+        arena,
+        (size_t) fishAmount * sizeof(int),
+        ARENA_MIN_ALIGN);
+    sorter->histograms = (int*) arena_alloc(
+        arena,
+        (size_t) sorter->threadCount * MORTON_RADIX_SIZE * sizeof(int),
+        ARENA_MIN_ALIGN);
+
+    return sorter;
+}
+
+/**
+ * Sorts the keys and the permutation with a LSD radix sort. Must be called by
+ * every thread of a parallel region. Each thread sorts a contiguous chunk of
+ * the keys, which keeps every pass stable.
+ *
+ * @param sorter the sorter holding the keys and the permutation
+ */
+void morton_sorter_radix_sort(MortonSorter* sorter) {
+    int threadNum = omp_get_thread_num();
+    int threads = omp_get_num_threads();
+    int chunk = (sorter->fishAmount + threads - 1) / threads;
+    int begin = threadNum * chunk;
+    int end = begin + chunk > sorter->fishAmount
+        ? sorter->fishAmount
+        : begin + chunk;
+    int* histogram = sorter->histograms + threadNum * MORTON_RADIX_SIZE;
+
+    for (int shift = 0; shift < MORTON_KEY_BITS; shift += MORTON_RADIX_BITS) {
+        uint32_t* keys = sorter->keys;
+        uint32_t* perm = sorter->perm;
+
+        memset(histogram, 0, MORTON_RADIX_SIZE * sizeof(int));
+        for (int k = begin; k < end; k++) {
+            histogram[(keys[k] >> shift) & (MORTON_RADIX_SIZE - 1)]++;
+        }
+
+        #pragma omp barrier
+
+        // Turn the counts into the position each thread writes a digit to,
+        // digits first then threads so the order within a digit is kept
+        #pragma omp single
+        {
+            int offset = 0;
+            for (int d = 0; d < MORTON_RADIX_SIZE; d++) {
+                for (int t = 0; t < threads; t++) {
+                    int count = sorter->histograms[t * MORTON_RADIX_SIZE + d];
+                    sorter->histograms[t * MORTON_RADIX_SIZE + d] = offset;
+                    offset += count;
+                }
+            }
+        }
+
+        for (int k = begin; k < end; k++) {
+            int pos = histogram[(keys[k] >> shift) & (MORTON_RADIX_SIZE - 1)]++;
+            sorter->keysTmp[pos] = keys[k];
+            sorter->permTmp[pos] = perm[k];
+        }
+
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            sorter->keys = sorter->keysTmp;
+            sorter->keysTmp = keys;
+            sorter->perm = sorter->permTmp;
+            sorter->permTmp = perm;
+        }
+    }
+}
+
+/**
+ * Reorders the fishes of the lake and their ids by the Morton key of their
+ * position. The lake's fishes and the ids are swapped with the sorter's
+ * buffers, so both pointers change.
+ *
+ * @param sorter the sorter
+ * @param fishLake the lake holding the fishes to sort
+ * @param ids the original id of every fish, reordered with the fishes
+ */
+void morton_sorter_sort(MortonSorter* sorter, FishLake* fishLake, int** ids) {
+    Fish* fishes = fishLake->fishes;
+    int* fishIds = *ids;
+    Fish* sortedFishes = sorter->fishesTmp;
+    int* sortedIds = sorter->idsTmp;
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (int k = 0; k < sorter->fishAmount; k++) {
+            sorter->keys[k] = morton_key(fishLake, fishes[k].position);
+            sorter->perm[k] = k;
+        }
+
+        morton_sorter_radix_sort(sorter);
+
+        #pragma omp for schedule(static)
+        for (int k = 0; k < sorter->fishAmount; k++) {
+            sortedFishes[k] = fishes[sorter->perm[k]];
+            sortedIds[k] = fishIds[sorter->perm[k]];
+        }
+    }
+
+    sorter->fishesTmp = fishes;
+    sorter->idsTmp = fishIds;
+    fishLake->fishes = sortedFishes;
+    *ids = sortedIds;
+}
+
+/**
+ * Puts the fishes of the lake back in the order of their original ids.
+ * Swaps the buffers the same way as morton_sorter_sort.
+ *
+ * @param sorter the sorter
+ * @param fishLake the lake holding the fishes to restore
+ * @param ids the original id of every fish, reordered with the fishes
+ * @param idOffset the id of the first fish of this lake
+ */
+void morton_sorter_restore(
+    MortonSorter* sorter,
+    FishLake* fishLake,
+    int** ids,
+    int idOffset) {
+    Fish* fishes = fishLake->fishes;
+    int* fishIds = *ids;
+    Fish* restoredFishes = sorter->fishesTmp;
+    int* restoredIds = sorter->idsTmp;
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < sorter->fishAmount; k++) {
+        restoredFishes[fishIds[k] - idOffset] = fishes[k];
+        restoredIds[fishIds[k] - idOffset] = fishIds[k];
+    }
+
+    sorter->fishesTmp = fishes;
+    sorter->idsTmp = fishIds;
+    fishLake->fishes = restoredFishes;
+    *ids = restoredIds;
+}
+
+/**
+ * Frees the MortonSorter, the buffers are released with the arena.
+ *
+ * @param sorter the sorter to be freed
+ */
+void morton_sorter_free(MortonSorter* sorter) {
+    free(sorter);
+}
+
+#endif
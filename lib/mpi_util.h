@@ -14,10 +14,12 @@
 
 #include "position.h"
 #include "fish.h"
+#include "fish_compact.h"
 
 // Custom MPI types
 MPI_Datatype MPI_SIM_POSITION;
 MPI_Datatype MPI_SIM_FISH;
+MPI_Datatype MPI_SIM_COMPACT_FISH;
 
 /**
  * Initializes the MPI datatype for the Position struct.
@@ -70,12 +72,50 @@ void mpi_util_init_type_fish() {
     MPI_Type_commit(&MPI_SIM_FISH);
 }
 
+/**
+ * Initializes the MPI datatype for the CompactFish struct. The extent is 
+ * resized to the struct so arrays of CompactFish can be sent.
+ */
+void mpi_util_init_type_compact_fish() {
+    int blockLengths[4] = {1,1,1,1};
+    MPI_Datatype types[4] = {
+        MPI_SIM_POSITION,
+        MPI_UINT16_T,
+        MPI_UINT16_T,
+        MPI_UINT32_T
+    };
+    MPI_Aint offsets[4];
+    MPI_Datatype packedType;
+
+    offsets[0] = offsetof(CompactFish, position);
+    offsets[1] = offsetof(CompactFish, initialWeight);
+    offsets[2] = offsetof(CompactFish, deltaF);
+    offsets[3] = offsetof(CompactFish, weightGain);
+
+    MPI_Type_create_struct(
+        4,
+        blockLengths,
+        offsets,
+        types,
+        &packedType
+    );
+    MPI_Type_create_resized(
+        packedType,
+        0,
+        sizeof(CompactFish),
+        &MPI_SIM_COMPACT_FISH
+    );
+    MPI_Type_commit(&MPI_SIM_COMPACT_FISH);
+    MPI_Type_free(&packedType);
+}
+
 /**
  * Initializes all MPI types used in the program.
  */
 void mpi_util_init_all_types() {
     mpi_util_init_type_position();
     mpi_util_init_type_fish();
+    mpi_util_init_type_compact_fish();
 }
 
 /**
@@ -84,6 +124,7 @@ void mpi_util_init_all_types() {
 void mpi_util_free_all_types() {
     MPI_Type_free(&MPI_SIM_POSITION);
     MPI_Type_free(&MPI_SIM_FISH);
+    MPI_Type_free(&MPI_SIM_COMPACT_FISH);
 }
 
 #endif
\ No newline at end of file
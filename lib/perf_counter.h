@@ -0,0 +1,411 @@
+/**
+ * @file perf_counter.h
+ *
+ * Contains hardware performance counter sampling through perf_event_open. The
+ * counters are opened once per OMP thread and read at the start and end of
+ * every simulation phase, so the counts are accumulated per thread and per
+ * phase. The totals can be aggregated over all processes and reported with
+ * derived metrics.
+ *
+ * When the counters are not available, e.g. perf_event_paranoid is too strict
+ * or running in a container, the affected events are reported as n/a and the
+ * simulation continues as normal.
+ *
+ * The PERF_PHASE_BEGIN and PERF_PHASE_END macros compile to nothing unless
+ * PERF_COUNTERS is defined.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_PERF_COUNTER
+#define SIM_H_PERF_COUNTER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <mpi.h>
+#include <omp.h>
+
+// Assumes 64 bytes are moved from memory for every last level cache miss
+#define PERF_CACHE_LINE_BYTES 64.0
+// Peak memory bandwidth of a node in GB/s, default is a dual socket AMD EPYC
+// 7763 node with 8 channels of DDR4-3200 per socket.
+#ifndef PERF_PEAK_BANDWIDTH_GBS
+    #define PERF_PEAK_BANDWIDTH_GBS 409.6
+#endif
+
+/**
+ * @brief The hardware events sampled.
+ */
+typedef enum PerfEvent
+{
+    PERF_EVENT_CYCLES,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_LLC_MISSES,
+    PERF_EVENT_DTLB_MISSES,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+} PerfEvent;
+
+/**
+ * @brief The phases of a simulation step.
+ */
+typedef enum PerfPhase
+{
+    PERF_PHASE_BARYCENTRE,
+    PERF_PHASE_SWIM,
+    PERF_PHASE_MAX_DELTA_F,
+    PERF_PHASE_EAT,
+    PERF_PHASE_COUNT
+} PerfPhase;
+
+const char* PERF_EVENT_NAMES[PERF_EVENT_COUNT] = {
+    "cycles",
+    "instructions",
+    "llc_misses",
+    "dtlb_misses",
+    "branch_misses"
+};
+
+const char* PERF_PHASE_NAMES[PERF_PHASE_COUNT] = {
+    "barycentre",
+    "swim",
+    "max_delta_f",
+    "eat"
+};
+
+/**
+ * @brief The counters owned by a single OMP thread.
+ *
+ * Padded to its own cache lines as every thread updates its own entry.
+ */
+typedef struct PerfThreadCounters
+{
+    // File descriptor of each event, -1 when the event is unavailable
+    int fds[PERF_EVENT_COUNT];
+    // Raw value, time enabled and time running at the start of the phase
+    uint64_t start[PERF_EVENT_COUNT][3];
+    // Accumulated counts of each phase, scaled for multiplexing
+    double totals[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+} __attribute__((aligned(64))) PerfThreadCounters;
+
+/**
+ * @brief The counters of all threads of a process.
+ */
+typedef struct PerfCounters
+{
+    PerfThreadCounters* threads;
+    int threadCount;
+    // Whether each event could be opened on every thread
+    int available[PERF_EVENT_COUNT];
+    // The errno of the first failed perf_event_open, 0 if none failed
+    int openError;
+    // Wall time spent in each phase measured by thread 0
+    double phaseTime[PERF_PHASE_COUNT];
+    double phaseStart;
+} PerfCounters;
+
+/**
+ * Fills in the perf_event_attr of the given event.
+ *
+ * @param attr the attribute to fill
+ * @param event the event
+ */
+void perf_counters_event_attr(struct perf_event_attr* attr, PerfEvent event) {
+    memset(attr, 0, sizeof(struct perf_event_attr));
+    attr->size = sizeof(struct perf_event_attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event) {
+        case PERF_EVENT_CYCLES:
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_EVENT_INSTRUCTIONS:
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_EVENT_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_EVENT_DTLB_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_DTLB
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+/**
+ * Opens the counters of the calling thread. Must be called by every thread of
+ * a parallel region, the counters then follow the thread with the same OMP
+ * thread number in later parallel regions.
+ *
+ * @param perfCounters the counters of the process
+ */
+void perf_counters_open_thread(PerfCounters* perfCounters) {
+    PerfThreadCounters* thread =
+        &perfCounters->threads[omp_get_thread_num()];
+    struct perf_event_attr attr;
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        perf_counters_event_attr(&attr, (PerfEvent) e);
+        // pid 0 and cpu -1 counts the calling thread on any cpu
+        thread->fds[e] = (int) syscall(SYS_perf_event_open, &attr, 0, -1,
+            -1, 0);
+
+        if (thread->fds[e] < 0) {
+            #pragma omp critical
+            {
+                perfCounters->available[e] = 0;
+                if (perfCounters->openError == 0) {
+                    perfCounters->openError = errno;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Creates the counters and opens them on every thread used by OMP.
+ *
+ * @return a pointer to the newly created PerfCounters
+ */
+PerfCounters* perf_counters_new() {
+    PerfCounters* perfCounters = (PerfCounters*) malloc(sizeof(PerfCounters));
+
+    perfCounters->threadCount = omp_get_max_threads();
+    perfCounters->threads = (PerfThreadCounters*) aligned_alloc(
+        64, perfCounters->threadCount * sizeof(PerfThreadCounters));
+    memset(perfCounters->threads, 0,
+        perfCounters->threadCount * sizeof(PerfThreadCounters));
+    memset(perfCounters->phaseTime, 0, sizeof(perfCounters->phaseTime));
+    perfCounters->openError = 0;
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        perfCounters->available[e] = 1;
+    }
+
+    #pragma omp parallel
+    {
+        perf_counters_open_thread(perfCounters);
+    }
+
+    return perfCounters;
+}
+
+/**
+ * Reads the raw value, time enabled and time running of a counter.
+ *
+ * @param fd the file descriptor of the counter
+ * @param values receives the 3 values
+ *
+ * @return 1 if the read succeeded, 0 otherwise
+ */
+int perf_counters_read(int fd, uint64_t values[3]) {
+    return read(fd, values, 3 * sizeof(uint64_t)) == 3 * sizeof(uint64_t);
+}
+
+/**
+ * Marks the start of a phase for the calling thread. Must be called inside the
+ * parallel region of the phase.
+ *
+ * @param perfCounters the counters of the process
+ */
+void perf_counters_phase_begin(PerfCounters* perfCounters) {
+    int threadNum = omp_get_thread_num();
+    PerfThreadCounters* thread = &perfCounters->threads[threadNum];
+
+    if (threadNum == 0) {
+        perfCounters->phaseStart = omp_get_wtime();
+    }
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (thread->fds[e] >= 0) {
+            perf_counters_read(thread->fds[e], thread->start[e]);
+        }
+    }
+}
+
+/**
+ * Marks the end of a phase for the calling thread and accumulates the counts.
+ * The counts are scaled by the time the counter was running, in case the
+ * kernel had to multiplex the counters.
+ *
+ * @param perfCounters the counters of the process
+ * @param phase the phase that ended
+ */
+void perf_counters_phase_end(PerfCounters* perfCounters, PerfPhase phase) {
+    int threadNum = omp_get_thread_num();
+    PerfThreadCounters* thread = &perfCounters->threads[threadNum];
+    uint64_t end[3];
+
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (thread->fds[e] >= 0 && perf_counters_read(thread->fds[e], end)) {
+            double value = (double) (end[0] - thread->start[e][0]);
+            double enabled = (double) (end[1] - thread->start[e][1]);
+            double running = (double) (end[2] - thread->start[e][2]);
+
+            if (running > 0 && running < enabled) {
+                value *= enabled / running;
+            }
+            thread->totals[phase][e] += value;
+        }
+    }
+
+    if (threadNum == 0) {
+        perfCounters->phaseTime[phase] +=
+            omp_get_wtime() - perfCounters->phaseStart;
+    }
+}
+
+/**
+ * Aggregates the counters of all processes and prints the per phase totals
+ * with derived metrics on the master rank. Collective over MPI_COMM_WORLD.
+ *
+ * @param perfCounters the counters of the process
+ * @param fishSteps the total amount of fish times the simulation steps
+ * @param masterRank the rank that prints the report
+ */
+void perf_counters_report(
+    PerfCounters* perfCounters,
+    double fishSteps,
+    int masterRank) {
+    // Per phase sum over threads of every event
+    double local[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+    double global[PERF_PHASE_COUNT][PERF_EVENT_COUNT];
+    // Per phase cycles of the busiest thread, used for the imbalance
+    double maxThreadCycles[PERF_PHASE_COUNT];
+    double globalMaxThreadCycles[PERF_PHASE_COUNT];
+    double globalPhaseTime[PERF_PHASE_COUNT];
+    int available[PERF_EVENT_COUNT];
+    int totalThreads;
+    int nodeCount;
+    int pRank;
+    int nodeRank;
+    MPI_Comm nodeComm;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    memset(local, 0, sizeof(local));
+
+    for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+        maxThreadCycles[p] = 0;
+        for (int t = 0; t < perfCounters->threadCount; t++) {
+            double* totals = perfCounters->threads[t].totals[p];
+            for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+                local[p][e] += totals[e];
+            }
+            if (totals[PERF_EVENT_CYCLES] > maxThreadCycles[p]) {
+                maxThreadCycles[p] = totals[PERF_EVENT_CYCLES];
+            }
+        }
+    }
+
+    // Count the nodes to scale the peak bandwidth
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, pRank,
+        MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    nodeRank = nodeRank == 0;
+    MPI_Reduce(&nodeRank, &nodeCount, 1, MPI_INT, MPI_SUM, masterRank,
+        MPI_COMM_WORLD);
+    MPI_Comm_free(&nodeComm);
+
+    MPI_Reduce(local, global, PERF_PHASE_COUNT * PERF_EVENT_COUNT,
+        MPI_DOUBLE, MPI_SUM, masterRank, MPI_COMM_WORLD);
+    MPI_Reduce(maxThreadCycles, globalMaxThreadCycles, PERF_PHASE_COUNT,
+        MPI_DOUBLE, MPI_MAX, masterRank, MPI_COMM_WORLD);
+    // The slowest process defines the time of a phase
+    MPI_Reduce(perfCounters->phaseTime, globalPhaseTime, PERF_PHASE_COUNT,
+        MPI_DOUBLE, MPI_MAX, masterRank, MPI_COMM_WORLD);
+    MPI_Reduce(perfCounters->available, available, PERF_EVENT_COUNT, MPI_INT,
+        MPI_MIN, masterRank, MPI_COMM_WORLD);
+    MPI_Reduce(&perfCounters->threadCount, &totalThreads, 1, MPI_INT,
+        MPI_SUM, masterRank, MPI_COMM_WORLD);
+
+    if (pRank != masterRank) {
+        return;
+    }
+
+    if (perfCounters->openError != 0) {
+        printf("Performance counters partially or fully unavailable: %s\n",
+            strerror(perfCounters->openError));
+    }
+
+    for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+        double* counts = global[p];
+        double bytes = counts[PERF_EVENT_LLC_MISSES] * PERF_CACHE_LINE_BYTES;
+        double bandwidth = bytes / globalPhaseTime[p] / 1e9;
+
+        printf("perf phase=%s, time=%f", PERF_PHASE_NAMES[p],
+            globalPhaseTime[p]);
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (available[e]) {
+                printf(", %s=%.0f", PERF_EVENT_NAMES[e], counts[e]);
+            } else {
+                printf(", %s=n/a", PERF_EVENT_NAMES[e]);
+            }
+        }
+
+        if (available[PERF_EVENT_CYCLES] && available[PERF_EVENT_INSTRUCTIONS]
+            && counts[PERF_EVENT_CYCLES] > 0) {
+            printf(", ipc=%f", counts[PERF_EVENT_INSTRUCTIONS]
+                / counts[PERF_EVENT_CYCLES]);
+            // The busiest thread against the average thread
+            printf(", thread_imbalance=%f", globalMaxThreadCycles[p]
+                / (counts[PERF_EVENT_CYCLES] / totalThreads));
+        } else {
+            printf(", ipc=n/a, thread_imbalance=n/a");
+        }
+
+        if (available[PERF_EVENT_LLC_MISSES] && globalPhaseTime[p] > 0) {
+            printf(", bytes_per_fish=%f, bandwidth_gbs=%f, peak_fraction=%f",
+                bytes / fishSteps, bandwidth,
+                bandwidth / (PERF_PEAK_BANDWIDTH_GBS * nodeCount));
+        } else {
+            printf(", bytes_per_fish=n/a, bandwidth_gbs=n/a, "
+                "peak_fraction=n/a");
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * Closes all counters and frees the PerfCounters.
+ *
+ * @param perfCounters the counters to be freed
+ */
+void perf_counters_free(PerfCounters* perfCounters) {
+    for (int t = 0; t < perfCounters->threadCount; t++) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (perfCounters->threads[t].fds[e] >= 0) {
+                close(perfCounters->threads[t].fds[e]);
+            }
+        }
+    }
+    free(perfCounters->threads);
+    free(perfCounters);
+}
+
+#if defined(PERF_COUNTERS)
+    #define PERF_PHASE_BEGIN(perfCounters) \
+        perf_counters_phase_begin(perfCounters)
+    #define PERF_PHASE_END(perfCounters, phase) \
+        perf_counters_phase_end(perfCounters, phase)
+#else
+    #define PERF_PHASE_BEGIN(perfCounters)
+    #define PERF_PHASE_END(perfCounters, phase)
+#endif
+
+#endif
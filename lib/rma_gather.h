@@ -0,0 +1,206 @@
+/**
+ * @file rma_gather.h
+ *
+ * Contains the collection of the fishes of every process on a single reader
+ * process with one sided MPI. Every process exposes its slice in a window and
+ * the reader pulls it in chunks with MPI_Rget, double buffered so the next
+ * chunk is on its way while the current one is consumed. The reader only ever
+ * holds two chunks, instead of every fish as with MPI_Gatherv.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_RMA_GATHER
+#define SIM_H_RMA_GATHER
+
+#include <stdlib.h>
+#include <mpi.h>
+
+/**
+ * Consumes a chunk of items pulled by the reader.
+ *
+ * @param items the items of the chunk
+ * @param offset the global index of the first item
+ * @param count the amount of items
+ * @param context the context given to rma_gather_pull
+ */
+typedef void (*RmaGatherSink)(
+    const void* items,
+    int offset,
+    int count,
+    void* context);
+
+/**
+ * @brief The window exposing the items of a process.
+ */
+typedef struct RmaGather
+{
+    MPI_Win win;
+    MPI_Datatype type;
+    size_t itemSize;
+    int chunkItems;
+} RmaGather;
+
+/**
+ * Creates the window exposing the local items. Collective over the
+ * communicator.
+ *
+ * @param items the local items
+ * @param count the amount of local items
+ * @param type the MPI datatype of an item
+ * @param itemSize the size of an item in bytes
+ * @param chunkItems the amount of items pulled at once
+ * @param comm the communicator
+ *
+ * @return a pointer to the newly created RmaGather
+ */
+RmaGather* rma_gather_new(
+    void* items,
+    int count,
+    MPI_Datatype type,
+    size_t itemSize,
+    int chunkItems,
+    MPI_Comm comm) {
+    RmaGather* rg = (RmaGather*) malloc(sizeof(RmaGather));
+
+    rg->type = type;
+    rg->itemSize = itemSize;
+    rg->chunkItems = chunkItems;
+    MPI_Win_create(
+        items,
+        (MPI_Aint) count * itemSize,
+        (int) itemSize,
+        MPI_INFO_NULL,
+        comm,
+        &rg->win);
+
+    return rg;
+}
+
+/**
+ * Issues the get of the next chunk, moving to the next process once all items
+ * of the current one were requested.
+ *
+ * @param rg the window
+ * @param counts the amount of items of every process
+ * @param targetCount the amount of processes
+ * @param target the process of the next chunk, updated
+ * @param disp the index of the next item within the process, updated
+ * @param buffer receives the chunk
+ * @param request receives the request of the get
+ *
+ * @return the amount of items requested, 0 when every item was requested
+ */
+int rma_gather_issue(
+    RmaGather* rg,
+    const int* counts,
+    int targetCount,
+    int* target,
+    int* disp,
+    void* buffer,
+    MPI_Request* request) {
+    int count;
+
+    while (*target < targetCount && *disp >= counts[*target]) {
+        (*target)++;
+        *disp = 0;
+    }
+    if (*target >= targetCount) {
+        return 0;
+    }
+
+    count = counts[*target] - *disp;
+    count = count > rg->chunkItems ? rg->chunkItems : count;
+    MPI_Rget(
+        buffer,
+        count,
+        rg->type,
+        *target,
+        *disp,
+        count,
+        rg->type,
+        rg->win,
+        request);
+    *disp += count;
+
+    return count;
+}
+
+/**
+ * Pulls every item of every process, in the order of the processes, and gives
+ * each chunk to the sink as soon as it arrived. Called by the reader only, the
+ * items must not change until the window is freed.
+ *
+ * @param rg the window
+ * @param counts the amount of items of every process
+ * @param targetCount the amount of processes
+ * @param sink consumes the chunks
+ * @param context passed to the sink
+ *
+ * @return the bytes of the chunk buffers held by the reader
+ */
+size_t rma_gather_pull(
+    RmaGather* rg,
+    const int* counts,
+    int targetCount,
+    RmaGatherSink sink,
+    void* context) {
+    size_t bufferBytes;
+    char* buffers[2];
+    MPI_Request requests[2];
+    int target = 0;
+    int disp = 0;
+    int offset = 0;
+    int current = 0;
+    int count;
+    int maxCount = 0;
+
+    // No chunk is larger than the largest slice
+    for (int k = 0; k < targetCount; k++) {
+        maxCount = counts[k] > maxCount ? counts[k] : maxCount;
+    }
+    if (maxCount < rg->chunkItems) {
+        rg->chunkItems = maxCount > 0 ? maxCount : 1;
+    }
+    bufferBytes = (size_t) rg->chunkItems * rg->itemSize;
+
+    buffers[0] = (char*) malloc(bufferBytes);
+    buffers[1] = (char*) malloc(bufferBytes);
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, rg->win);
+
+    count = rma_gather_issue(rg, counts, targetCount, &target, &disp,
+        buffers[current], &requests[current]);
+    while (count > 0) {
+        int next = current ^ 1;
+        int nextCount = rma_gather_issue(rg, counts, targetCount, &target,
+            &disp, buffers[next], &requests[next]);
+
+        MPI_Wait(&requests[current], MPI_STATUS_IGNORE);
+        sink(buffers[current], offset, count, context);
+
+        offset += count;
+        count = nextCount;
+        current = next;
+    }
+
+    MPI_Win_unlock_all(rg->win);
+
+    free(buffers[0]);
+    free(buffers[1]);
+
+    return 2 * bufferBytes;
+}
+
+/**
+ * Frees the window, which waits for the reader to finish. Collective over the
+ * communicator of the window.
+ *
+ * @param rg the window to be freed
+ */
+void rma_gather_free(RmaGather* rg) {
+    MPI_Win_free(&rg->win);
+    free(rg);
+}
+
+#endif
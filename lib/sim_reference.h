@@ -0,0 +1,367 @@
+/**
+ * @file sim_reference.h
+ *
+ * Contains the reference engine used to verify the simulation. It runs the
+ * simulation of every fish on a single thread, written out plainly without
+ * any of the optimisations, and compares the values of every step and the
+ * final fishes against the ones of the optimised simulation.
+ *
+ * Both draw from the per fish counter based random streams, so every fish
+ * swims the same no matter how the fishes are split over the processes and
+ * threads. The fishes and the max deltaF are then expected to match within a
+ * few ULP, while the barycentre and the objective value are sums whose order
+ * changes with the split and are compared with a relative tolerance.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_SIM_REFERENCE
+#define SIM_H_SIM_REFERENCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "fish.h"
+#include "fish_lake.h"
+#include "sim_util.h"
+
+// The largest difference in ULP allowed for the values of a fish and deltaF
+#ifndef SIM_VERIFY_ULP
+    #define SIM_VERIFY_ULP 4
+#endif
+// The largest relative error allowed for the barycentre and objective value
+#ifndef SIM_VERIFY_REL_TOL
+    #define SIM_VERIFY_REL_TOL 1e-4
+#endif
+// The amount of mismatching fishes printed
+#define SIM_VERIFY_MAX_PRINTED 10
+
+typedef enum SimRefValue {
+    SIM_REF_BARYCENTRE,
+    SIM_REF_OBJECTIVE,
+    SIM_REF_MAX_DELTA_F,
+    SIM_REF_VALUE_COUNT
+} SimRefValue;
+
+/**
+ * @brief The reference simulation and the errors found against it.
+ */
+typedef struct SimReference
+{
+    // A copy of every fish
+    Fish* fishes;
+    int fishAmount;
+    float coordMinX;
+    float coordMaxX;
+    float coordMinY;
+    float coordMaxY;
+    uint64_t fishSeed;
+    int steps;
+    int failedSteps;
+    int failedFishes;
+    double maxRelError[2];
+    uint32_t maxStepUlp;
+    uint32_t maxFishUlp;
+} SimReference;
+
+/**
+ * Creates the reference from a copy of the initial fishes of the lake.
+ *
+ * @param fishLake the lake with every fish, before the first step
+ * @param fishSeed the seed of the per fish random streams
+ *
+ * @return a pointer to the newly created SimReference
+ */
+SimReference* sim_reference_new(const FishLake* fishLake, uint64_t fishSeed) {
+    SimReference* ref = (SimReference*) malloc(sizeof(SimReference));
+    size_t bytes = (size_t) fishLake->fish_amount * sizeof(Fish);
+
+    ref->fishes = (Fish*) malloc(bytes);
+    memcpy(ref->fishes, fishLake->fishes, bytes);
+    ref->fishAmount = fishLake->fish_amount;
+    ref->coordMinX = fishLake->coord_min_x;
+    ref->coordMaxX = fishLake->coord_max_x;
+    ref->coordMinY = fishLake->coord_min_y;
+    ref->coordMaxY = fishLake->coord_max_y;
+    ref->fishSeed = fishSeed;
+    ref->steps = 0;
+    ref->failedSteps = 0;
+    ref->failedFishes = 0;
+    ref->maxRelError[0] = 0.0;
+    ref->maxRelError[1] = 0.0;
+    ref->maxStepUlp = 0;
+    ref->maxFishUlp = 0;
+
+    return ref;
+}
+
+/**
+ * Returns the distance in units in the last place between two floats, the
+ * number of floats between them.
+ *
+ * @param a the first float
+ * @param b the second float
+ *
+ * @return the distance in ULP, UINT32_MAX if either is NaN
+ */
+uint32_t sim_reference_ulp(float a, float b) {
+    int32_t ia;
+    int32_t ib;
+    int64_t distance;
+
+    if (isnan(a) || isnan(b)) {
+        return UINT32_MAX;
+    }
+
+    memcpy(&ia, &a, sizeof(float));
+    memcpy(&ib, &b, sizeof(float));
+    // Maps the sign magnitude floats to a monotonic integer order
+    ia = ia < 0 ? INT32_MIN - ia : ia;
+    ib = ib < 0 ? INT32_MIN - ib : ib;
+    distance = (int64_t) ia - (int64_t) ib;
+
+    return (uint32_t) (distance < 0 ? -distance : distance);
+}
+
+/**
+ * Returns the relative error of a value against the expected value.
+ *
+ * @param value the value
+ * @param expected the expected value
+ *
+ * @return the relative error
+ */
+double sim_reference_rel_error(double value, double expected) {
+    return expected == 0.0
+        ? fabs(value)
+        : fabs(value - expected) / fabs(expected);
+}
+
+/**
+ * Bounds a coordinate of a move to the lake by the boundary policy, written
+ * out with plain branches, see fish_lake_bound_coord.
+ *
+ * @param coord the coordinate before the move
+ * @param newCoord the coordinate after the move
+ * @param min the lower wall
+ * @param max the upper wall
+ *
+ * @return the coordinate within the lake
+ */
+float sim_reference_bound(float coord, float newCoord, float min, float max) {
+#if defined(BOUNDARY_CLAMP) || defined(BOUNDARY_REFLECT) \
+    || defined(BOUNDARY_WRAP)
+    // Only the revert policy goes back to the old coordinate
+    (void) coord;
+#endif
+#if defined(BOUNDARY_CLAMP)
+    if (newCoord < min) {
+        return min;
+    }
+    if (newCoord > max) {
+        return max;
+    }
+    return newCoord;
+#elif defined(BOUNDARY_REFLECT)
+    if (newCoord < min) {
+        return min + (min - newCoord);
+    }
+    if (newCoord > max) {
+        return max - (newCoord - max);
+    }
+    return newCoord;
+#elif defined(BOUNDARY_WRAP)
+    if (newCoord < min) {
+        return newCoord + (max - min);
+    }
+    if (newCoord > max) {
+        return newCoord - (max - min);
+    }
+    return newCoord;
+#else
+    // A move out of the lake is reverted in that direction
+    if (newCoord >= min && newCoord <= max) {
+        return newCoord;
+    }
+    return coord;
+#endif
+}
+
+/**
+ * Runs a single step of the reference simulation: the barycentre, the swim,
+ * the max deltaF and the eat, in the same order as the simulation.
+ *
+ * @param ref the reference
+ * @param step the step, the position in the random streams
+ * @param values receives the values of the step, in the order of SimRefValue
+ */
+void sim_reference_step(
+    SimReference* ref,
+    int step,
+    float values[SIM_REF_VALUE_COUNT]) {
+    double sumOfDistWeight = 0.0;
+    double objectiveValue = 0.0;
+    float maxDeltaF = 0.0f;
+
+    for (int k = 0; k < ref->fishAmount; k++) {
+        sumOfDistWeight += (double) ref->fishes[k].distanceFromOrigin
+            * ref->fishes[k].weight;
+        objectiveValue += ref->fishes[k].distanceFromOrigin;
+    }
+
+    for (int k = 0; k < ref->fishAmount; k++) {
+        Fish* fish = &(ref->fishes[k]);
+        float x = fish->position.x + rand_hash_float(ref->fishSeed, k,
+            2 * step, FISH_SWIM_MIN, FISH_SWIM_MAX);
+        float y = fish->position.y + rand_hash_float(ref->fishSeed, k,
+            2 * step + 1, FISH_SWIM_MIN, FISH_SWIM_MAX);
+        float oldDistance = fish->distanceFromOrigin;
+
+        fish->position.x = sim_reference_bound(
+            fish->position.x, x, ref->coordMinX, ref->coordMaxX);
+        fish->position.y = sim_reference_bound(
+            fish->position.y, y, ref->coordMinY, ref->coordMaxY);
+
+        fish->distanceFromOrigin = sqrt(fish->position.x * fish->position.x
+            + fish->position.y * fish->position.y);
+        fish->deltaF = fabsf(fish->distanceFromOrigin - oldDistance);
+        if (fish->deltaF > maxDeltaF) {
+            maxDeltaF = fish->deltaF;
+        }
+    }
+
+    for (int k = 0; k < ref->fishAmount; k++) {
+        Fish* fish = &(ref->fishes[k]);
+        float weight = fish->weight + fish->deltaF / maxDeltaF;
+
+        if (weight < FISH_INIT_WEIGHT_MIN) {
+            weight = FISH_INIT_WEIGHT_MIN;
+        }
+        if (weight > fish->initialWeight * FISH_WEIGHT_MAX_SCALE) {
+            weight = fish->initialWeight * FISH_WEIGHT_MAX_SCALE;
+        }
+        fish->weight = weight;
+    }
+
+    values[SIM_REF_BARYCENTRE] = (float) (sumOfDistWeight / objectiveValue);
+    values[SIM_REF_OBJECTIVE] = (float) objectiveValue;
+    values[SIM_REF_MAX_DELTA_F] = maxDeltaF;
+}
+
+/**
+ * Runs the next step of the reference simulation and compares its values
+ * against the ones of the simulation, printing a record when they differ.
+ *
+ * @param ref the reference
+ * @param values the values of the simulation, in the order of SimRefValue
+ *
+ * @return 1 if the values match, 0 otherwise
+ */
+int sim_reference_check_step(
+    SimReference* ref,
+    const float values[SIM_REF_VALUE_COUNT]) {
+    float expected[SIM_REF_VALUE_COUNT];
+    double relErrors[2];
+    uint32_t ulp;
+    int match;
+
+    sim_reference_step(ref, ref->steps, expected);
+
+    for (int k = 0; k < 2; k++) {
+        relErrors[k] = sim_reference_rel_error(values[k], expected[k]);
+        ref->maxRelError[k] = fmax(ref->maxRelError[k], relErrors[k]);
+    }
+    ulp = sim_reference_ulp(
+        values[SIM_REF_MAX_DELTA_F],
+        expected[SIM_REF_MAX_DELTA_F]);
+    ref->maxStepUlp = ulp > ref->maxStepUlp ? ulp : ref->maxStepUlp;
+
+    match = relErrors[0] <= SIM_VERIFY_REL_TOL
+        && relErrors[1] <= SIM_VERIFY_REL_TOL
+        && ulp <= SIM_VERIFY_ULP;
+    if (!match) {
+        printf("verify mismatch step=%d, barycentre_rel_error=%e, "
+            "objective_rel_error=%e, max_delta_f_ulp=%u\n", ref->steps,
+            relErrors[0], relErrors[1], ulp);
+        ref->failedSteps++;
+    }
+    ref->steps++;
+
+    return match;
+}
+
+/**
+ * Compares the fishes at the end of the simulation against the fishes of the
+ * reference, printing a record for the first mismatching ones.
+ *
+ * @param ref the reference
+ * @param fishes every fish of the simulation, in the original order
+ *
+ * @return the amount of mismatching fishes
+ */
+int sim_reference_check_fishes(SimReference* ref, const Fish* fishes) {
+    for (int k = 0; k < ref->fishAmount; k++) {
+        const Fish* fish = &(fishes[k]);
+        const Fish* expected = &(ref->fishes[k]);
+        uint32_t ulps[5] = {
+            sim_reference_ulp(fish->position.x, expected->position.x),
+            sim_reference_ulp(fish->position.y, expected->position.y),
+            sim_reference_ulp(fish->distanceFromOrigin,
+                expected->distanceFromOrigin),
+            sim_reference_ulp(fish->weight, expected->weight),
+            sim_reference_ulp(fish->deltaF, expected->deltaF)
+        };
+        uint32_t ulp = 0;
+
+        for (int i = 0; i < 5; i++) {
+            ulp = ulps[i] > ulp ? ulps[i] : ulp;
+        }
+        ref->maxFishUlp = ulp > ref->maxFishUlp ? ulp : ref->maxFishUlp;
+
+        if (ulp > SIM_VERIFY_ULP) {
+            if (ref->failedFishes < SIM_VERIFY_MAX_PRINTED) {
+                printf("verify mismatch fish=%d, x_ulp=%u, y_ulp=%u, "
+                    "distance_ulp=%u, weight_ulp=%u, delta_f_ulp=%u\n", k,
+                    ulps[0], ulps[1], ulps[2], ulps[3], ulps[4]);
+            }
+            ref->failedFishes++;
+        }
+    }
+
+    return ref->failedFishes;
+}
+
+/**
+ * Prints the outcome of the verification as a single record.
+ *
+ * @param ref the reference
+ *
+ * @return 1 if everything matched, 0 otherwise
+ */
+int sim_reference_report(const SimReference* ref) {
+    int passed = ref->failedSteps == 0 && ref->failedFishes == 0;
+
+    printf("verify steps=%d, failed_steps=%d, fishes=%d, failed_fishes=%d, "
+        "max_barycentre_rel_error=%e, max_objective_rel_error=%e, "
+        "max_delta_f_ulp=%u, max_fish_ulp=%u, result=%s\n", ref->steps,
+        ref->failedSteps, ref->fishAmount, ref->failedFishes,
+        ref->maxRelError[0], ref->maxRelError[1], ref->maxStepUlp,
+        ref->maxFishUlp, passed ? "PASS" : "FAIL");
+
+    return passed;
+}
+
+/**
+ * Frees the reference and its fishes.
+ *
+ * @param ref the reference to be freed
+ */
+void sim_reference_free(SimReference* ref) {
+    free(ref->fishes);
+    free(ref);
+}
+
+#endif
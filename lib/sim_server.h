@@ -0,0 +1,351 @@
+/**
+ * @file sim_server.h
+ *
+ * Contains the job description of a simulation run and the server that reads
+ * jobs for a long lived simulation process. The jobs are read on the master
+ * process, either from a job file or from the clients of a local UNIX socket,
+ * and the result of every job is written back as a key=value record. A client
+ * that disconnects before its result is written is dropped, the server goes
+ * on with the next client.
+ *
+ * A job is a line of key=value pairs separated by spaces or commas, e.g.
+ *     fish_amount=1000000 steps=100 seed=42 schedule=guided threads=32
+ * Missing keys take their default values, empty lines and lines starting with
+ * # are skipped and a line with quit stops the server.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_SIM_SERVER
+#define SIM_H_SIM_SERVER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+
+#define SIM_JOB_DEFAULT_STEPS 10
+#define SIM_JOB_LINE_SIZE 512
+// Addresses starting with this are UNIX sockets, anything else a job file
+#define SIM_SERVER_UNIX_PREFIX "unix:"
+
+typedef enum SimSchedule {
+    SIM_SCHEDULE_STATIC,
+    SIM_SCHEDULE_DYNAMIC,
+    SIM_SCHEDULE_GUIDED,
+    SIM_SCHEDULE_COUNT
+} SimSchedule;
+
+const char* SIM_SCHEDULE_NAMES[SIM_SCHEDULE_COUNT] = {
+    "static",
+    "dynamic",
+    "guided"
+};
+
+const omp_sched_t SIM_SCHEDULE_KINDS[SIM_SCHEDULE_COUNT] = {
+    omp_sched_static,
+    omp_sched_dynamic,
+    omp_sched_guided
+};
+
+/**
+ * @brief The parameters of a single simulation run. Plain ints so it can be
+ * broadcast as bytes.
+ */
+typedef struct SimJob
+{
+    int id;
+    int fishAmount;
+    int simulationSteps;
+    unsigned int seed;
+    int schedule;
+    int threads;
+    // Set when there are no more jobs
+    int quit;
+} SimJob;
+
+/**
+ * @brief The outcome of a simulation run, as seen by the master process.
+ */
+typedef struct SimResult
+{
+    int stepsRun;
+    double timeTaken;
+    // From the moment the run was requested to the start of the first step
+    double timeToFirstStep;
+    float barycentre;
+} SimResult;
+
+/**
+ * @brief The source of the jobs and the destination of the results.
+ */
+typedef struct SimServer
+{
+    FILE* in;
+    FILE* out;
+    // The listening socket, -1 when reading a job file
+    int listenFd;
+    // The threads of a job that does not give them, fixed when the server is
+    // created as every job changes the threads of the process
+    int defaultThreads;
+} SimServer;
+
+/**
+ * Initialises a job with the default values.
+ *
+ * @param job the job to initialise
+ */
+void sim_job_init(SimJob* job) {
+    job->id = 0;
+    job->fishAmount = 0;
+    job->simulationSteps = SIM_JOB_DEFAULT_STEPS;
+    job->seed = time(NULL);
+    job->schedule = SIM_SCHEDULE_STATIC;
+    job->threads = omp_get_max_threads();
+    job->quit = 0;
+}
+
+/**
+ * Parses a job line, the values not in the line are left unchanged.
+ *
+ * @param line the line to parse, modified by the parsing
+ * @param job receives the values of the line
+ *
+ * @return 1 if the line is a valid job, 0 otherwise
+ */
+int sim_job_parse(char* line, SimJob* job) {
+    char* savePtr;
+
+    for (char* token = strtok_r(line, " ,\t\r\n", &savePtr);
+        token != NULL;
+        token = strtok_r(NULL, " ,\t\r\n", &savePtr)) {
+        char* value = strchr(token, '=');
+
+        if (strcmp(token, "quit") == 0) {
+            job->quit = 1;
+            continue;
+        }
+        if (value == NULL) {
+            return 0;
+        }
+        *value++ = '\0';
+
+        if (strcmp(token, "fish_amount") == 0) {
+            job->fishAmount = atoi(value);
+        } else if (strcmp(token, "steps") == 0
+            || strcmp(token, "simulation_steps") == 0) {
+            job->simulationSteps = atoi(value);
+        } else if (strcmp(token, "seed") == 0) {
+            job->seed = (unsigned int) strtoul(value, NULL, 10);
+        } else if (strcmp(token, "threads") == 0) {
+            job->threads = atoi(value);
+        } else if (strcmp(token, "schedule") == 0) {
+            job->schedule = -1;
+            for (int k = 0; k < SIM_SCHEDULE_COUNT; k++) {
+                if (strcmp(value, SIM_SCHEDULE_NAMES[k]) == 0) {
+                    job->schedule = k;
+                }
+            }
+        } else {
+            return 0;
+        }
+    }
+
+    return job->quit || (job->fishAmount > 0
+        && job->simulationSteps > 0
+        && job->threads > 0
+        && job->schedule >= 0);
+}
+
+/**
+ * Creates a new server reading jobs from the given address. A UNIX socket is
+ * created at the path after SIM_SERVER_UNIX_PREFIX, replacing any file there,
+ * otherwise the address is the path of a job file and the results are written
+ * to a duplicate of stdout, so stdout itself can be redirected for the logs.
+ *
+ * @param address the socket address or the job file path
+ *
+ * @return a pointer to the newly created SimServer, NULL on failure
+ */
+SimServer* sim_server_new(const char* address) {
+    SimServer* server = (SimServer*) malloc(sizeof(SimServer));
+    size_t prefixLength = strlen(SIM_SERVER_UNIX_PREFIX);
+
+    server->in = NULL;
+    server->out = stdout;
+    server->listenFd = -1;
+    server->defaultThreads = omp_get_max_threads();
+
+    if (strncmp(address, SIM_SERVER_UNIX_PREFIX, prefixLength) == 0) {
+        struct sockaddr_un sockAddr;
+
+        // Writing to a client that has gone fails with EPIPE instead of
+        // killing the process
+        signal(SIGPIPE, SIG_IGN);
+
+        memset(&sockAddr, 0, sizeof(sockAddr));
+        sockAddr.sun_family = AF_UNIX;
+        strncpy(sockAddr.sun_path, address + prefixLength,
+            sizeof(sockAddr.sun_path) - 1);
+        unlink(sockAddr.sun_path);
+
+        server->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server->listenFd < 0
+            || bind(server->listenFd, (struct sockaddr*) &sockAddr,
+                sizeof(sockAddr)) != 0
+            || listen(server->listenFd, 1) != 0) {
+            perror("sim_server_new");
+            if (server->listenFd >= 0) {
+                close(server->listenFd);
+            }
+            free(server);
+            return NULL;
+        }
+        server->out = NULL;
+    } else {
+        server->in = fopen(address, "r");
+        if (server->in == NULL) {
+            perror("sim_server_new");
+            free(server);
+            return NULL;
+        }
+        fflush(stdout);
+        server->out = fdopen(dup(STDOUT_FILENO), "w");
+    }
+
+    return server;
+}
+
+/**
+ * Closes the connection to the current client of a socket server.
+ *
+ * @param server the server
+ */
+void sim_server_close_client(SimServer* server) {
+    // in and out share the descriptor, out is a duplicate of it
+    if (server->in != NULL) {
+        fclose(server->in);
+        server->in = NULL;
+    }
+    if (server->out != NULL) {
+        fclose(server->out);
+        server->out = NULL;
+    }
+}
+
+/**
+ * Finishes a reply to the current client. A reply that could not be written
+ * drops a socket client, the next job is then read from the next client.
+ *
+ * @param server the server
+ * @param written the result of writing the reply, negative on failure
+ *
+ * @return 1 if the reply was delivered, 0 otherwise
+ */
+int sim_server_end_reply(SimServer* server, int written) {
+    if (written >= 0 && fflush(server->out) == 0) {
+        return 1;
+    }
+
+    perror("sim_server_end_reply");
+    if (server->listenFd >= 0) {
+        sim_server_close_client(server);
+    }
+    return 0;
+}
+
+/**
+ * Reads the next job. A socket server waits for the next client once the
+ * current one disconnects. Invalid lines are reported and skipped.
+ *
+ * @param server the server
+ * @param job receives the job, starting from the default values
+ *
+ * @return 1 if a job was read, 0 when there are no more jobs
+ */
+int sim_server_next_job(SimServer* server, SimJob* job) {
+    char line[SIM_JOB_LINE_SIZE];
+
+    while (1) {
+        if (server->in == NULL) {
+            int clientFd = accept(server->listenFd, NULL, NULL);
+
+            if (clientFd < 0) {
+                perror("sim_server_next_job");
+                return 0;
+            }
+            server->in = fdopen(clientFd, "r");
+            server->out = fdopen(dup(clientFd), "w");
+        }
+
+        if (fgets(line, sizeof(line), server->in) == NULL) {
+            if (server->listenFd < 0) {
+                return 0;
+            }
+            sim_server_close_client(server);
+            continue;
+        }
+
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        sim_job_init(job);
+        job->threads = server->defaultThreads;
+        if (!sim_job_parse(line, job)) {
+            sim_server_end_reply(
+                server,
+                fprintf(server->out, "error invalid_job\n"));
+            continue;
+        }
+
+        return !job->quit;
+    }
+}
+
+/**
+ * Writes the result of a job as a single record, see sim_server_end_reply.
+ *
+ * @param server the server
+ * @param job the job
+ * @param result the result of the job
+ * @param processes the number of processes the job ran on
+ *
+ * @return 1 if the result was delivered, 0 otherwise
+ */
+int sim_server_send_result(
+    SimServer* server,
+    const SimJob* job,
+    const SimResult* result,
+    int processes) {
+    return sim_server_end_reply(server, fprintf(server->out, "job id=%d, "
+        "fish_amount=%d, simulation_steps=%d, num_of_processes=%d, "
+        "num_of_threads=%d, schedule=%s, seed=%u, time_taken=%f, "
+        "time_to_first_step=%f, barycentre=%f\n",
+        job->id, job->fishAmount, result->stepsRun, processes, job->threads,
+        SIM_SCHEDULE_NAMES[job->schedule], job->seed, result->timeTaken,
+        result->timeToFirstStep, result->barycentre));
+}
+
+/**
+ * Frees the server, closing the current client and the socket.
+ *
+ * @param server the server to be freed
+ */
+void sim_server_free(SimServer* server) {
+    if (server->listenFd >= 0) {
+        sim_server_close_client(server);
+        close(server->listenFd);
+    } else {
+        fclose(server->in);
+        fclose(server->out);
+    }
+    free(server);
+}
+
+#endif
@@ -0,0 +1,293 @@
+/**
+ * @file sim_stats.h
+ *
+ * Contains streaming statistics of the fish school that can be collected while
+ * the fishes are being swept, instead of gathering every fish to the master.
+ *
+ * The statistics are fixed size and mergeable: a weight histogram, the weight
+ * mean and variance, the weight min and max, a quantile sketch of deltaF and a
+ * coarse occupancy grid of the lake. Every thread collects its own state, the
+ * thread states are merged with sim_stats_merge and the process states with a
+ * custom MPI operation.
+ *
+ * The deltaF quantiles come from a DDSketch style log bucket sketch. Unlike a
+ * t-digest or KLL sketch its state is a fixed array of counters, so merging is
+ * an element wise sum and the whole state fits a single MPI reduction.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_SIM_STATS
+#define SIM_H_SIM_STATS
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <mpi.h>
+
+#include "fish.h"
+#include "fish_lake.h"
+#include "sim_util.h"
+
+#define SIM_STATS_WEIGHT_BINS 64
+#define SIM_STATS_WEIGHT_MIN FISH_INIT_WEIGHT_MIN
+#define SIM_STATS_WEIGHT_MAX (FISH_INIT_WEIGHT_MAX * FISH_WEIGHT_MAX_SCALE)
+// The lake is divided into GRID_SIZE x GRID_SIZE cells
+#define SIM_STATS_GRID_SIZE 32
+// Relative accuracy of the deltaF quantiles
+#define SIM_STATS_SKETCH_ALPHA 0.02
+#define SIM_STATS_SKETCH_BUCKETS 512
+// deltaF below this value is counted in the zero bucket
+#define SIM_STATS_SKETCH_MIN_VALUE 1e-7f
+
+/**
+ * @brief Mergeable statistics of a set of fishes.
+ */
+typedef struct SimStats
+{
+    // Weight count, mean and sum of squared differences from the mean
+    double count;
+    double weightMean;
+    double weightM2;
+    float weightMin;
+    float weightMax;
+    uint32_t weightHistogram[SIM_STATS_WEIGHT_BINS];
+    // Occupancy grid, row major with y as the row
+    uint32_t grid[SIM_STATS_GRID_SIZE * SIM_STATS_GRID_SIZE];
+    // deltaF sketch, bucket i counts values in (gamma^(i-1), gamma^i] offset
+    // by the bucket of SIM_STATS_SKETCH_MIN_VALUE
+    uint32_t sketchZero;
+    uint32_t sketch[SIM_STATS_SKETCH_BUCKETS];
+} SimStats;
+
+/**
+ * @brief The statistics collected by a single thread, padded to whole cache
+ * lines so the statistics of neighbouring threads never share one.
+ */
+typedef struct SimThreadStats
+{
+    SimStats stats;
+} __attribute__((aligned(64))) SimThreadStats;
+
+// Custom MPI type and operation to reduce SimStats
+MPI_Datatype MPI_SIM_STATS;
+MPI_Op MPI_SIM_STATS_MERGE;
+
+/**
+ * Returns the log of the sketch growth factor gamma.
+ *
+ * @return log(gamma)
+ */
+double sim_stats_sketch_log_gamma() {
+    return log((1.0 + SIM_STATS_SKETCH_ALPHA) / (1.0 - SIM_STATS_SKETCH_ALPHA));
+}
+
+/**
+ * Initialises empty statistics.
+ *
+ * @param stats the statistics to initialise
+ */
+void sim_stats_init(SimStats* stats) {
+    memset(stats, 0, sizeof(SimStats));
+    stats->weightMin = INFINITY;
+    stats->weightMax = -INFINITY;
+}
+
+/**
+ * Adds a fish to the statistics. The fish is given by its values so any
+ * storage of the fish can be used.
+ *
+ * @param stats the statistics to add to
+ * @param weight the weight of the fish
+ * @param position the position of the fish
+ * @param deltaF the deltaF of the fish
+ * @param fishLake the lake of the fish, used for the occupancy grid
+ */
+void sim_stats_add(
+    SimStats* stats,
+    float weight,
+    Position position,
+    float deltaF,
+    const FishLake* fishLake) {
+    double delta = weight - stats->weightMean;
+    int bin;
+    int cellX;
+    int cellY;
+
+    // Welford's online update of the mean and variance
+    stats->count += 1.0;
+    stats->weightMean += delta / stats->count;
+    stats->weightM2 += delta * (weight - stats->weightMean);
+    stats->weightMin = min_float(stats->weightMin, weight);
+    stats->weightMax = max_float(stats->weightMax, weight);
+
+    bin = (int) ((weight - SIM_STATS_WEIGHT_MIN)
+        / (SIM_STATS_WEIGHT_MAX - SIM_STATS_WEIGHT_MIN) * SIM_STATS_WEIGHT_BINS);
+    bin = bin < 0 ? 0 : bin;
+    bin = bin >= SIM_STATS_WEIGHT_BINS ? SIM_STATS_WEIGHT_BINS - 1 : bin;
+    stats->weightHistogram[bin]++;
+
+    cellX = (int) ((position.x - fishLake->coord_min_x)
+        / (fishLake->coord_max_x - fishLake->coord_min_x)
+        * SIM_STATS_GRID_SIZE);
+    cellY = (int) ((position.y - fishLake->coord_min_y)
+        / (fishLake->coord_max_y - fishLake->coord_min_y)
+        * SIM_STATS_GRID_SIZE);
+    cellX = cellX >= SIM_STATS_GRID_SIZE ? SIM_STATS_GRID_SIZE - 1 : cellX;
+    cellY = cellY >= SIM_STATS_GRID_SIZE ? SIM_STATS_GRID_SIZE - 1 : cellY;
+    stats->grid[cellY * SIM_STATS_GRID_SIZE + cellX]++;
+
+    if (deltaF < SIM_STATS_SKETCH_MIN_VALUE) {
+        stats->sketchZero++;
+    } else {
+        int bucket = (int) ceil(
+            (log(deltaF) - log(SIM_STATS_SKETCH_MIN_VALUE))
+            / sim_stats_sketch_log_gamma());
+        bucket = bucket >= SIM_STATS_SKETCH_BUCKETS
+            ? SIM_STATS_SKETCH_BUCKETS - 1
+            : bucket;
+        stats->sketch[bucket]++;
+    }
+}
+
+/**
+ * Merges the statistics of src into dst.
+ *
+ * @param dst the statistics to merge into
+ * @param src the statistics to merge
+ */
+void sim_stats_merge(SimStats* dst, const SimStats* src) {
+    double count = dst->count + src->count;
+
+    if (src->count == 0) {
+        return;
+    }
+
+    // Chan et al. parallel combination of the mean and variance
+    if (dst->count == 0) {
+        dst->weightMean = src->weightMean;
+        dst->weightM2 = src->weightM2;
+    } else {
+        double delta = src->weightMean - dst->weightMean;
+        dst->weightMean += delta * src->count / count;
+        dst->weightM2 += src->weightM2
+            + delta * delta * dst->count * src->count / count;
+    }
+    dst->count = count;
+    dst->weightMin = min_float(dst->weightMin, src->weightMin);
+    dst->weightMax = max_float(dst->weightMax, src->weightMax);
+
+    for (int i = 0; i < SIM_STATS_WEIGHT_BINS; i++) {
+        dst->weightHistogram[i] += src->weightHistogram[i];
+    }
+    for (int i = 0; i < SIM_STATS_GRID_SIZE * SIM_STATS_GRID_SIZE; i++) {
+        dst->grid[i] += src->grid[i];
+    }
+    dst->sketchZero += src->sketchZero;
+    for (int i = 0; i < SIM_STATS_SKETCH_BUCKETS; i++) {
+        dst->sketch[i] += src->sketch[i];
+    }
+}
+
+/**
+ * The MPI user function merging SimStats, see MPI_Op_create.
+ */
+void sim_stats_mpi_merge(
+    void* in,
+    void* inout,
+    int* len,
+    MPI_Datatype* datatype) {
+    SimStats* src = (SimStats*) in;
+    SimStats* dst = (SimStats*) inout;
+
+    (void) datatype;
+    for (int i = 0; i < *len; i++) {
+        sim_stats_merge(&dst[i], &src[i]);
+    }
+}
+
+/**
+ * Initialises the MPI datatype and operation used to reduce SimStats.
+ */
+void sim_stats_mpi_init() {
+    MPI_Type_contiguous(sizeof(SimStats), MPI_BYTE, &MPI_SIM_STATS);
+    MPI_Type_commit(&MPI_SIM_STATS);
+    MPI_Op_create(sim_stats_mpi_merge, 1, &MPI_SIM_STATS_MERGE);
+}
+
+/**
+ * Frees the MPI datatype and operation used to reduce SimStats.
+ */
+void sim_stats_mpi_free() {
+    MPI_Op_free(&MPI_SIM_STATS_MERGE);
+    MPI_Type_free(&MPI_SIM_STATS);
+}
+
+/**
+ * Estimates the quantile of deltaF from the sketch. The estimate is within
+ * SIM_STATS_SKETCH_ALPHA relative error of a value of the given rank.
+ *
+ * @param stats the statistics
+ * @param quantile the quantile between 0 and 1
+ *
+ * @return the estimated deltaF of the quantile
+ */
+float sim_stats_delta_f_quantile(const SimStats* stats, double quantile) {
+    double rank = quantile * (stats->count - 1);
+    double seen = stats->sketchZero;
+    double logGamma = sim_stats_sketch_log_gamma();
+
+    if (rank < seen) {
+        return 0.0f;
+    }
+
+    for (int i = 0; i < SIM_STATS_SKETCH_BUCKETS; i++) {
+        seen += stats->sketch[i];
+        if (rank < seen) {
+            // The middle of the bucket in relative terms
+            return (float) (2.0 * SIM_STATS_SKETCH_MIN_VALUE
+                * exp(i * logGamma) / (1.0 + exp(logGamma)));
+        }
+    }
+
+    return (float) (SIM_STATS_SKETCH_MIN_VALUE
+        * exp((SIM_STATS_SKETCH_BUCKETS - 1) * logGamma));
+}
+
+/**
+ * Prints the statistics as a single record.
+ *
+ * @param stats the statistics
+ * @param step the simulation step the statistics are of
+ */
+void sim_stats_print(const SimStats* stats, int step) {
+    uint32_t maxCell = 0;
+    int occupiedCells = 0;
+
+    for (int i = 0; i < SIM_STATS_GRID_SIZE * SIM_STATS_GRID_SIZE; i++) {
+        occupiedCells += stats->grid[i] > 0;
+        if (stats->grid[i] > maxCell) {
+            maxCell = stats->grid[i];
+        }
+    }
+
+    printf("stats step=%d, weight_mean=%f, weight_variance=%f, "
+        "weight_min=%f, weight_max=%f, delta_f_p50=%f, delta_f_p90=%f, "
+        "delta_f_p99=%f, occupied_cells=%d, max_cell_fraction=%f, "
+        "weight_histogram=",
+        step, stats->weightMean, stats->weightM2 / stats->count,
+        stats->weightMin, stats->weightMax,
+        sim_stats_delta_f_quantile(stats, 0.5),
+        sim_stats_delta_f_quantile(stats, 0.9),
+        sim_stats_delta_f_quantile(stats, 0.99),
+        occupiedCells, maxCell / stats->count);
+
+    // Separated by ; so the record keeps one field per statistic
+    for (int i = 0; i < SIM_STATS_WEIGHT_BINS; i++) {
+        printf(i == 0 ? "%u" : ";%u", stats->weightHistogram[i]);
+    }
+    printf("\n");
+}
+
+#endif
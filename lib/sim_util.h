@@ -12,6 +12,7 @@
 #define SIM_UTIL_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /**
  * Generates a random float between min and max
@@ -40,6 +41,45 @@ float rand_r_float(unsigned int * seed, float min, float max) {
     return min + randFloat * (max - min);
 }
 
+/**
+ * Mixes the bits of a 64 bit value, the finaliser of splitmix64.
+ *
+ * @param x the value to mix
+ *
+ * @return the mixed value
+ */
+uint64_t rand_hash(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Generates a random float between min and max from a counter based stream.
+ * The same seed, stream and counter always give the same value, no matter 
+ * which thread or process asks for it or in which order.
+ *
+ * @param seed the seed shared by all streams
+ * @param stream the stream, e.g. the id of a fish
+ * @param counter the position in the stream
+ * @param min the minimum value for the random float
+ * @param max the maximum value for the random float
+ *
+ * @return a random float between the minimum and maximum values
+ */
+float rand_hash_float(
+    uint64_t seed,
+    uint64_t stream,
+    uint64_t counter,
+    float min,
+    float max) {
+    uint64_t hash = rand_hash(seed ^ rand_hash(stream ^ rand_hash(counter)));
+    // The top 24 bits fill the mantissa of a float in [0, 1)
+    float randFloat = (float) (hash >> 40) / 16777216.0f;
+    return min + randFloat * (max - min);
+}
+
 /**
  * Returns the maximum value between two floats.
  *
@@ -0,0 +1,237 @@
+/**
+ * @file tile_scheduler.h
+ *
+ * Contains a work stealing scheduler of tiles of fishes, an alternative to the
+ * OMP loop schedules. The fishes are split into tiles sized to stay in the
+ * cache and every thread starts with a contiguous block of tiles, the same
+ * locality as the static schedule. A thread only steals, from the back of
+ * another thread's block, once its own block is empty.
+ *
+ * The remaining tiles of a thread are a range packed into one 64 bit atomic.
+ * The owner takes tiles from the front and thieves from the back, both with a
+ * compare and swap, so no locks are needed. Tiles are never pushed during a
+ * phase which keeps the deque this simple.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_TILE_SCHEDULER
+#define SIM_H_TILE_SCHEDULER
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <omp.h>
+
+// Fishes per tile, 8192 fishes of 24 bytes fits in a 256KB L2 cache
+#ifndef TILE_SCHEDULER_TILE_SIZE
+    #define TILE_SCHEDULER_TILE_SIZE 8192
+#endif
+
+/**
+ * @brief The tiles left to a thread, on its own cache line.
+ */
+typedef struct TileDeque
+{
+    // The tiles [front, back), front in the low and back in the high 32 bits
+    _Atomic uint64_t range;
+    // The amount of tiles this thread stole, only updated by the owner
+    long steals;
+} __attribute__((aligned(64))) TileDeque;
+
+/**
+ * @brief Work stealing scheduler over a fixed amount of items.
+ */
+typedef struct TileScheduler
+{
+    TileDeque* deques;
+    // The maximum amount of threads, one deque each
+    int threadCount;
+    // The amount of items, fishes, to be scheduled
+    int itemCount;
+    int tileSize;
+    int tileCount;
+} TileScheduler;
+
+/**
+ * Packs a range of tiles into the 64 bit representation.
+ *
+ * @param front the first tile
+ * @param back one past the last tile
+ *
+ * @return the packed range
+ */
+uint64_t tile_range_pack(uint32_t front, uint32_t back) {
+    return ((uint64_t) back << 32) | front;
+}
+
+/**
+ * Creates a new TileScheduler for the given amount of items.
+ *
+ * @param itemCount the amount of items to schedule
+ * @param tileSize the amount of items per tile
+ *
+ * @return a pointer to the newly created TileScheduler
+ */
+TileScheduler* tile_scheduler_new(int itemCount, int tileSize) {
+    TileScheduler* scheduler = (TileScheduler*) malloc(sizeof(TileScheduler));
+
+    scheduler->threadCount = omp_get_max_threads();
+    scheduler->itemCount = itemCount;
+    scheduler->tileSize = tileSize;
+    scheduler->tileCount = (itemCount + tileSize - 1) / tileSize;
+    scheduler->deques = (TileDeque*) aligned_alloc(
+        64, scheduler->threadCount * sizeof(TileDeque));
+
+    for (int t = 0; t < scheduler->threadCount; t++) {
+        atomic_init(&scheduler->deques[t].range, 0);
+        scheduler->deques[t].steals = 0;
+    }
+
+    return scheduler;
+}
+
+/**
+ * Starts a phase. Must be called by every thread of the parallel region, each
+ * thread gets back its contiguous block of tiles.
+ *
+ * @param scheduler the scheduler
+ */
+void tile_scheduler_begin(TileScheduler* scheduler) {
+    int threadNum = omp_get_thread_num();
+    int threads = omp_get_num_threads();
+    int size = scheduler->tileCount / threads;
+    int reminder = scheduler->tileCount % threads;
+    // Same split as the work partition, the reminder goes to the first ones
+    uint32_t front = threadNum * size
+        + (threadNum < reminder ? threadNum : reminder);
+    uint32_t back = front + size + (threadNum < reminder);
+
+    atomic_store_explicit(
+        &scheduler->deques[threadNum].range,
+        tile_range_pack(front, back),
+        memory_order_relaxed);
+
+    // No thread may look for work before every block is in place
+    #pragma omp barrier
+}
+
+/**
+ * Takes the front tile of the given deque, used by the owner.
+ *
+ * @param deque the deque of the calling thread
+ * @param tile receives the tile
+ *
+ * @return 1 if a tile was taken, 0 if the deque is empty
+ */
+int tile_deque_pop_front(TileDeque* deque, uint32_t* tile) {
+    uint64_t range = atomic_load_explicit(&deque->range, memory_order_acquire);
+
+    while (1) {
+        uint32_t front = (uint32_t) range;
+        uint32_t back = (uint32_t) (range >> 32);
+
+        if (front >= back) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(
+            &deque->range, &range, tile_range_pack(front + 1, back),
+            memory_order_acq_rel, memory_order_acquire)) {
+            *tile = front;
+            return 1;
+        }
+    }
+}
+
+/**
+ * Takes the back tile of the given deque, used by thieves.
+ *
+ * @param deque the deque of another thread
+ * @param tile receives the tile
+ *
+ * @return 1 if a tile was taken, 0 if the deque is empty
+ */
+int tile_deque_pop_back(TileDeque* deque, uint32_t* tile) {
+    uint64_t range = atomic_load_explicit(&deque->range, memory_order_acquire);
+
+    while (1) {
+        uint32_t front = (uint32_t) range;
+        uint32_t back = (uint32_t) (range >> 32);
+
+        if (front >= back) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(
+            &deque->range, &range, tile_range_pack(front, back - 1),
+            memory_order_acq_rel, memory_order_acquire)) {
+            *tile = back - 1;
+            return 1;
+        }
+    }
+}
+
+/**
+ * Gets the next range of items for the calling thread. The thread's own tiles
+ * are taken in order, after that tiles are stolen from the other threads
+ * starting with the next thread.
+ *
+ * @param scheduler the scheduler
+ * @param begin receives the first item of the range
+ * @param end receives one past the last item of the range
+ *
+ * @return 1 if a range was given, 0 if every tile of the phase has been taken
+ */
+int tile_scheduler_next(TileScheduler* scheduler, int* begin, int* end) {
+    int threadNum = omp_get_thread_num();
+    int threads = omp_get_num_threads();
+    TileDeque* own = &scheduler->deques[threadNum];
+    uint32_t tile;
+    int found = tile_deque_pop_front(own, &tile);
+
+    // Tiles are never added during a phase, so once every deque was seen
+    // empty there is no work left
+    for (int i = 1; !found && i < threads; i++) {
+        found = tile_deque_pop_back(
+            &scheduler->deques[(threadNum + i) % threads], &tile);
+        own->steals += found;
+    }
+
+    if (!found) {
+        return 0;
+    }
+
+    *begin = tile * scheduler->tileSize;
+    *end = *begin + scheduler->tileSize;
+    if (*end > scheduler->itemCount) {
+        *end = scheduler->itemCount;
+    }
+    return 1;
+}
+
+/**
+ * Returns the amount of tiles stolen by all threads so far.
+ *
+ * @param scheduler the scheduler
+ *
+ * @return the amount of stolen tiles
+ */
+long tile_scheduler_steals(TileScheduler* scheduler) {
+    long steals = 0;
+
+    for (int t = 0; t < scheduler->threadCount; t++) {
+        steals += scheduler->deques[t].steals;
+    }
+    return steals;
+}
+
+/**
+ * Frees the TileScheduler.
+ *
+ * @param scheduler the scheduler to be freed
+ */
+void tile_scheduler_free(TileScheduler* scheduler) {
+    free(scheduler->deques);
+    free(scheduler);
+}
+
+#endif
@@ -0,0 +1,360 @@
+/**
+ * @file trace.h
+ *
+ * Contains the event tracing of the simulation. Every OMP thread records the
+ * begin and end of the phases, MPI calls and steps into its own fixed size
+ * ring buffer, so recording takes no lock and no atomic operation. Once the
+ * buffer is full the oldest events are overwritten.
+ *
+ * The clocks of the processes are aligned to the clock of the root process at
+ * startup, and after the run the events of every process are gathered and
+ * written by the root as Chrome trace JSON, which Perfetto and
+ * chrome://tracing can load. Each process is shown as a pid and each thread
+ * as a tid.
+ *
+ * The TRACE_BEGIN and TRACE_END macros compile to nothing unless SIM_TRACE is
+ * defined.
+ *
+ * @author Tao Hu
+*/
+
+#ifndef SIM_H_TRACE
+#define SIM_H_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <mpi.h>
+#include <omp.h>
+
+// Events kept per thread, a power of two
+#ifndef TRACE_BUFFER_EVENTS
+    #define TRACE_BUFFER_EVENTS (1 << 14)
+#endif
+// Round trips used to align the clock of a process, the fastest one is used
+#define TRACE_CLOCK_ROUNDS 16
+
+/**
+ * @brief The traced regions.
+ */
+typedef enum TraceName
+{
+    TRACE_STEP,
+    TRACE_BARYCENTRE,
+    TRACE_SWIM,
+    TRACE_MAX_DELTA_F,
+    TRACE_EAT,
+    TRACE_ALLREDUCE,
+    TRACE_SCATTER,
+    TRACE_COLLECT,
+    TRACE_STATS_REDUCE,
+    TRACE_MORTON_SORT,
+    TRACE_NAME_COUNT
+} TraceName;
+
+const char* TRACE_NAMES[TRACE_NAME_COUNT] = {
+    "step",
+    "barycentre",
+    "swim",
+    "max_delta_f",
+    "eat",
+    "allreduce",
+    "scatter",
+    "collect",
+    "stats_reduce",
+    "morton_sort"
+};
+
+/**
+ * @brief A single begin or end of a traced region.
+ */
+typedef struct TraceEvent
+{
+    // Seconds on the clock of this process, on the clock of the root process
+    // relative to the start of the trace once exported
+    double time;
+    int16_t name;
+    int16_t thread;
+    // 'B' for begin and 'E' for end
+    char phase;
+} TraceEvent;
+
+/**
+ * @brief The ring buffer of a thread, on its own cache lines so threads do
+ * not share them.
+ */
+typedef struct TraceBuffer
+{
+    TraceEvent* events;
+    // The amount of events ever recorded, the next one goes to count modulo
+    // TRACE_BUFFER_EVENTS
+    uint64_t count;
+} __attribute__((aligned(64))) TraceBuffer;
+
+/**
+ * @brief The trace of a process.
+ */
+typedef struct Tracer
+{
+    TraceBuffer* buffers;
+    int threadCount;
+    // Added to the local clock to get the clock of the root process
+    double clockOffset;
+    // The start of the trace on the clock of the root process
+    double origin;
+} Tracer;
+
+/**
+ * Finds the offset from the local clock to the clock of the root with the
+ * round trip of a message, taking the fastest of TRACE_CLOCK_ROUNDS rounds.
+ * Collective over the communicator.
+ *
+ * @param comm the communicator
+ * @param root the process whose clock the others align to
+ *
+ * @return the offset to add to the local clock
+ */
+double trace_clock_offset(MPI_Comm comm, int root) {
+    double offset = 0.0;
+    double bestRoundTrip = 1e30;
+    int rank;
+    int size;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    for (int r = 0; r < size; r++) {
+        if (r == root) {
+            continue;
+        }
+
+        for (int k = 0; k < TRACE_CLOCK_ROUNDS; k++) {
+            if (rank == root) {
+                double rootTime;
+
+                MPI_Recv(&rootTime, 1, MPI_DOUBLE, r, 0, comm,
+                    MPI_STATUS_IGNORE);
+                rootTime = omp_get_wtime();
+                MPI_Send(&rootTime, 1, MPI_DOUBLE, r, 0, comm);
+            } else if (rank == r) {
+                double sendTime = omp_get_wtime();
+                double rootTime;
+                double receiveTime;
+
+                MPI_Send(&sendTime, 1, MPI_DOUBLE, root, 0, comm);
+                MPI_Recv(&rootTime, 1, MPI_DOUBLE, root, 0, comm,
+                    MPI_STATUS_IGNORE);
+                receiveTime = omp_get_wtime();
+
+                // The root read its clock halfway through the round trip
+                if (receiveTime - sendTime < bestRoundTrip) {
+                    bestRoundTrip = receiveTime - sendTime;
+                    offset = rootTime - (sendTime + receiveTime) / 2.0;
+                }
+            }
+        }
+    }
+
+    return offset;
+}
+
+/**
+ * Creates the trace of this process with a buffer for every OMP thread, each
+ * allocated and touched by its own thread. Collective over the communicator.
+ *
+ * @param comm the communicator
+ * @param root the process whose clock the others align to
+ *
+ * @return a pointer to the newly created Tracer
+ */
+Tracer* trace_new(MPI_Comm comm, int root) {
+    Tracer* tracer = (Tracer*) malloc(sizeof(Tracer));
+
+    tracer->threadCount = omp_get_max_threads();
+    tracer->buffers = (TraceBuffer*) aligned_alloc(
+        64,
+        tracer->threadCount * sizeof(TraceBuffer));
+
+    #pragma omp parallel
+    {
+        TraceBuffer* buffer = &(tracer->buffers[omp_get_thread_num()]);
+
+        buffer->events = (TraceEvent*) malloc(
+            TRACE_BUFFER_EVENTS * sizeof(TraceEvent));
+        memset(buffer->events, 0, TRACE_BUFFER_EVENTS * sizeof(TraceEvent));
+        buffer->count = 0;
+    }
+
+    tracer->clockOffset = trace_clock_offset(comm, root);
+    tracer->origin = omp_get_wtime();
+    MPI_Bcast(&tracer->origin, 1, MPI_DOUBLE, root, comm);
+
+    return tracer;
+}
+
+/**
+ * Records an event in the buffer of the calling thread.
+ *
+ * @param tracer the trace
+ * @param name the traced region
+ * @param phase 'B' for begin and 'E' for end
+ */
+void trace_record(Tracer* tracer, TraceName name, char phase) {
+    int thread = omp_get_thread_num();
+    TraceBuffer* buffer = &(tracer->buffers[thread]);
+    TraceEvent* event =
+        &(buffer->events[buffer->count & (TRACE_BUFFER_EVENTS - 1)]);
+
+    event->time = omp_get_wtime();
+    event->name = (int16_t) name;
+    event->thread = (int16_t) thread;
+    event->phase = phase;
+    buffer->count++;
+}
+
+/**
+ * Writes the events of every process to the file as Chrome trace JSON.
+ *
+ * @param file the file
+ * @param events the events of every process, one after the other
+ * @param counts the amount of events of every process
+ * @param processes the amount of processes
+ */
+void trace_write_json(
+    FILE* file,
+    const TraceEvent* events,
+    const int* counts,
+    int processes) {
+    int first = 1;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int p = 0; p < processes; p++) {
+        fprintf(file, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"rank %d\"}}", first ? "" : ",\n", p, p);
+        first = 0;
+
+        for (int k = 0; k < counts[p]; k++) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d}", TRACE_NAMES[events[k].name],
+                events[k].phase, events[k].time * 1e6, p, events[k].thread);
+        }
+        events += counts[p];
+    }
+    fprintf(file, "\n]}\n");
+}
+
+/**
+ * Gathers the events of every process on the root, which writes them to the
+ * file as Chrome trace JSON and prints the amount of events. Collective over
+ * the communicator.
+ *
+ * @param tracer the trace of this process
+ * @param path the path of the JSON file
+ * @param comm the communicator
+ * @param root the process writing the file
+ */
+void trace_export(Tracer* tracer, const char* path, MPI_Comm comm, int root) {
+    int localCount = 0;
+    long localDropped = 0;
+    long dropped;
+    TraceEvent* localEvents;
+    TraceEvent* events = NULL;
+    int* counts = NULL;
+    int* byteCounts = NULL;
+    int* byteOffsets = NULL;
+    int rank;
+    int size;
+    int total = 0;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    for (int t = 0; t < tracer->threadCount; t++) {
+        uint64_t count = tracer->buffers[t].count;
+        localCount += count < TRACE_BUFFER_EVENTS ? count : TRACE_BUFFER_EVENTS;
+        localDropped += count < TRACE_BUFFER_EVENTS
+            ? 0
+            : count - TRACE_BUFFER_EVENTS;
+    }
+
+    // Oldest first per thread, on the clock of the root
+    localEvents = (TraceEvent*) malloc(
+        (localCount > 0 ? localCount : 1) * sizeof(TraceEvent));
+    localCount = 0;
+    for (int t = 0; t < tracer->threadCount; t++) {
+        TraceBuffer* buffer = &(tracer->buffers[t]);
+        uint64_t begin = buffer->count < TRACE_BUFFER_EVENTS
+            ? 0
+            : buffer->count - TRACE_BUFFER_EVENTS;
+
+        for (uint64_t k = begin; k < buffer->count; k++) {
+            TraceEvent event = buffer->events[k & (TRACE_BUFFER_EVENTS - 1)];
+            event.time += tracer->clockOffset - tracer->origin;
+            localEvents[localCount++] = event;
+        }
+    }
+
+    if (rank == root) {
+        counts = (int*) malloc(size * sizeof(int));
+        byteCounts = (int*) malloc(size * sizeof(int));
+        byteOffsets = (int*) malloc(size * sizeof(int));
+    }
+    MPI_Gather(&localCount, 1, MPI_INT, counts, 1, MPI_INT, root, comm);
+    MPI_Reduce(&localDropped, &dropped, 1, MPI_LONG, MPI_SUM, root, comm);
+
+    if (rank == root) {
+        for (int p = 0; p < size; p++) {
+            byteCounts[p] = counts[p] * (int) sizeof(TraceEvent);
+            byteOffsets[p] = total * (int) sizeof(TraceEvent);
+            total += counts[p];
+        }
+        events = (TraceEvent*) malloc(
+            (total > 0 ? total : 1) * sizeof(TraceEvent));
+    }
+
+    MPI_Gatherv(localEvents, localCount * (int) sizeof(TraceEvent), MPI_BYTE,
+        events, byteCounts, byteOffsets, MPI_BYTE, root, comm);
+
+    if (rank == root) {
+        FILE* file = fopen(path, "w");
+
+        if (file == NULL) {
+            perror("trace_export");
+        } else {
+            trace_write_json(file, events, counts, size);
+            fclose(file);
+        }
+        printf("trace file=%s, events=%d, dropped=%ld\n", path, total,
+            dropped);
+
+        free(events);
+        free(counts);
+        free(byteCounts);
+        free(byteOffsets);
+    }
+    free(localEvents);
+}
+
+/**
+ * Frees the trace and the buffers of every thread.
+ *
+ * @param tracer the trace to be freed
+ */
+void trace_free(Tracer* tracer) {
+    for (int t = 0; t < tracer->threadCount; t++) {
+        free(tracer->buffers[t].events);
+    }
+    free(tracer->buffers);
+    free(tracer);
+}
+
+#if defined(SIM_TRACE)
+    #define TRACE_BEGIN(tracer, name) trace_record(tracer, name, 'B')
+    #define TRACE_END(tracer, name) trace_record(tracer, name, 'E')
+#else
+    #define TRACE_BEGIN(tracer, name)
+    #define TRACE_END(tracer, name)
+#endif
+
+#endif
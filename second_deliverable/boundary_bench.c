@@ -0,0 +1,156 @@
+/**
+ * @file boundary_bench.c
+ *
+ * Measures the swim of the boundary policy the benchmark is compiled with, see
+ * fish_lake_bound_coord, as the fraction of the fishes near a wall grows. A
+ * fish near a wall is within a swim of it, so about a quarter of its moves
+ * leave the lake in each direction, while the other fishes never reach a wall.
+ * The throughput and the branch misses of every fraction are printed.
+ *
+ * The moves are drawn once up front so the passes only time the swim, and the
+ * fishes are put back before every pass so every pass sees the same fraction.
+ * Compiled with mpicc for perf_counter.h, but runs as a single process.
+ *
+ * @author Tao Hu
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../lib/fish_lake.h"
+#include "../lib/sim_util.h"
+#include "../lib/perf_counter.h"
+
+#define BENCH_FISH_AMOUNT (1 << 22)
+#define BENCH_PASSES 20
+#define BENCH_SEED 5507
+#define FISH_LAKE_WIDTH 200.0f
+#define FISH_LAKE_HEIGHT 200.0f
+
+const float BENCH_NEAR_WALL_FRACTIONS[] = {
+    0.0f, 0.01f, 0.05f, 0.1f, 0.25f, 0.5f, 1.0f
+};
+
+/**
+ * Places the fishes of the lake, the given fraction of them within a swim of
+ * a wall in both directions and the others away from every wall.
+ *
+ * @param fishLake the lake
+ * @param nearWallFraction the fraction of the fishes near a wall
+ */
+static void bench_place_fishes(FishLake* fishLake, float nearWallFraction) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < fishLake->fish_amount; i++) {
+        Position pos;
+
+        if (rand_hash_float(BENCH_SEED, i, 0, 0.0f, 1.0f) < nearWallFraction) {
+            // Within a swim of one of the walls of both directions
+            float x = rand_hash_float(BENCH_SEED, i, 1, 0.0f, FISH_SWIM_MAX);
+            float y = rand_hash_float(BENCH_SEED, i, 2, 0.0f, FISH_SWIM_MAX);
+
+            pos.x = rand_hash(BENCH_SEED ^ i) & 1
+                ? fishLake->coord_max_x - x
+                : fishLake->coord_min_x + x;
+            pos.y = rand_hash(BENCH_SEED ^ i) & 2
+                ? fishLake->coord_max_y - y
+                : fishLake->coord_min_y + y;
+        } else {
+            pos.x = rand_hash_float(BENCH_SEED, i, 1,
+                fishLake->coord_min_x + FISH_SWIM_MAX,
+                fishLake->coord_max_x - FISH_SWIM_MAX);
+            pos.y = rand_hash_float(BENCH_SEED, i, 2,
+                fishLake->coord_min_y + FISH_SWIM_MAX,
+                fishLake->coord_max_y - FISH_SWIM_MAX);
+        }
+
+        fish_init_weighted(&(fishLake->fishes[i]), pos, FISH_INIT_WEIGHT_MIN);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int fishAmount = BENCH_FISH_AMOUNT;
+    int fractionCount = sizeof(BENCH_NEAR_WALL_FRACTIONS) / sizeof(float);
+    FishLake* fishLake;
+    Fish* initialFishes;
+    float* moves;
+
+    if (argc >= 2 && atoi(argv[1]) > 0) {
+        fishAmount = atoi(argv[1]);
+    }
+
+    fishLake = fish_lake_new(fishAmount, FISH_LAKE_WIDTH, FISH_LAKE_HEIGHT);
+    initialFishes = (Fish*) malloc((size_t) fishAmount * sizeof(Fish));
+    moves = (float*) malloc((size_t) fishAmount * 2 * sizeof(float));
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < fishAmount; i++) {
+        moves[2 * i] = rand_hash_float(BENCH_SEED, i, 3,
+            FISH_SWIM_MIN, FISH_SWIM_MAX);
+        moves[2 * i + 1] = rand_hash_float(BENCH_SEED, i, 4,
+            FISH_SWIM_MIN, FISH_SWIM_MAX);
+    }
+
+    for (int f = 0; f < fractionCount; f++) {
+        PerfCounters* perfCounters = perf_counters_new();
+        double branchMisses = 0;
+        double instructions = 0;
+        double fishSteps = (double) fishAmount * BENCH_PASSES;
+
+        bench_place_fishes(fishLake, BENCH_NEAR_WALL_FRACTIONS[f]);
+        memcpy(initialFishes, fishLake->fishes,
+            (size_t) fishAmount * sizeof(Fish));
+
+        #pragma omp parallel
+        {
+            for (int pass = 0; pass < BENCH_PASSES; pass++) {
+                #pragma omp for schedule(static)
+                for (int i = 0; i < fishAmount; i++) {
+                    fishLake->fishes[i] = initialFishes[i];
+                }
+
+                perf_counters_phase_begin(perfCounters);
+
+                #pragma omp for schedule(static)
+                for (int i = 0; i < fishAmount; i++) {
+                    fish_lake_fish_move(
+                        fishLake,
+                        &(fishLake->fishes[i]),
+                        moves[2 * i],
+                        moves[2 * i + 1]);
+                }
+
+                perf_counters_phase_end(perfCounters, PERF_PHASE_SWIM);
+            }
+        }
+
+        for (int t = 0; t < perfCounters->threadCount; t++) {
+            double* totals = perfCounters->threads[t].totals[PERF_PHASE_SWIM];
+
+            branchMisses += totals[PERF_EVENT_BRANCH_MISSES];
+            instructions += totals[PERF_EVENT_INSTRUCTIONS];
+        }
+
+        printf("boundary policy=%s, near_wall_fraction=%f, threads=%d, "
+            "fish_steps_per_second=%e", FISH_LAKE_BOUNDARY_STR,
+            BENCH_NEAR_WALL_FRACTIONS[f], omp_get_max_threads(),
+            fishSteps / perfCounters->phaseTime[PERF_PHASE_SWIM]);
+        if (perfCounters->available[PERF_EVENT_BRANCH_MISSES]
+            && perfCounters->available[PERF_EVENT_INSTRUCTIONS]) {
+            printf(", branch_misses_per_fish=%f, branch_mpki=%f\n",
+                branchMisses / fishSteps,
+                branchMisses / instructions * 1000.0);
+        } else {
+            printf(", branch_misses_per_fish=n/a, branch_mpki=n/a\n");
+        }
+
+        perf_counters_free(perfCounters);
+    }
+
+    fish_lake_free(fishLake);
+    free(initialFishes);
+    free(moves);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --nodes=1
+#SBATCH --ntasks=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:10:00
+
+# Benchmark the swim of every boundary policy as the fraction of the fishes 
+# near a wall grows, with a single thread and with every thread of the node.
+# The branch misses need the performance counters, see perf_counter.h.
+
+GCC_LIB_LINK='-lm'
+GCC_OPTIONS="${GCC_LIB_LINK} -fopenmp -O2"
+C_FILE_NAME="boundary_bench"
+
+OUT_DIR="exp_data"
+OUT_FILE="${OUT_DIR}/boundary_bench.txt"
+
+FISH_AMOUNT=16777216
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+for policy in "" "-D BOUNDARY_CLAMP" "-D BOUNDARY_REFLECT" "-D BOUNDARY_WRAP"
+do
+    mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_OPTIONS $policy
+
+    for threads in 1 $THREAD_NUM
+    do
+        OMP_NUM_THREADS=$threads srun -n 1 -c $SLURM_CPUS_PER_TASK \
+            $C_FILE_NAME $FISH_AMOUNT >> $OUT_FILE
+    done
+done
+
+grep "^boundary" $OUT_FILE
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=2
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Compare the compact storage against the full precision fishes. Both builds
+# run with the same seed and the static schedule, so they draw the same random
+# numbers and the difference of the per step values is the error caused by the
+# reduced precision alone. The time_taken lines compare the throughput of the
+# two storages, and the storage line reports the weight cap check.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+GCC_OPTIONS="${GCC_LIB_LINK} -D PRINT_STEPS"
+
+OUT_DIR="exp_data"
+
+FISH_AMOUNT=25000000
+SIM_STEPS=100
+SEED=5507
+PROCESS_NUM=2
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+FULL_FILE="${OUT_DIR}/compact_full_${FISH_AMOUNT}_${SIM_STEPS}.txt"
+COMPACT_FILE="${OUT_DIR}/compact_${FISH_AMOUNT}_${SIM_STEPS}.txt"
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_OPTIONS -fopenmp
+srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+    $C_FILE_NAME $FISH_AMOUNT $SIM_STEPS $SEED > $FULL_FILE
+
+mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_OPTIONS -fopenmp -D SIM_COMPACT
+srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+    $C_FILE_NAME $FISH_AMOUNT $SIM_STEPS $SEED > $COMPACT_FILE
+
+grep "time_taken\|storage" $FULL_FILE $COMPACT_FILE
+
+# The largest relative error of each value over all steps
+paste -d ',' <(grep "^step" $FULL_FILE) <(grep "^step" $COMPACT_FILE) | \
+awk -F', ?' '
+function value(field) {
+    split(field, kv, "=")
+    return kv[2]
+}
+function rel(a, b) {
+    return a == 0 ? 0 : (a > b ? a - b : b - a) / (a < 0 ? -a : a)
+}
+{
+    for (k = 2; k <= 4; k++) {
+        error = rel(value($k), value($(k + 4)))
+        if (error > maxError[k]) maxError[k] = error
+    }
+}
+END {
+    printf "compact max_rel_error_barycentre=%e, " \
+        "max_rel_error_objective=%e, max_rel_error_max_delta_f=%e\n", \
+        maxError[2], maxError[3], maxError[4]
+}'
@@ -0,0 +1,56 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=4
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Check that the convergence monitor only stops for a real reason. The short
+# runs are still speeding up, the fishes keep heading for the shore and gaining
+# weight, so none of them should stop in either mode however small or large
+# the school. The long runs go on until the fishes have piled up at the shore,
+# there the max deltaF falls to a tenth of its start and the any mode stops on
+# it, and with the tolerances of the all mode raised to 1e-5 and half of the
+# first window all three values settle.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+
+OUT_DIR="exp_data"
+
+SHORT_STEPS=100
+LONG_STEPS=20000
+LONG_FISH=20000
+SEED=5507
+PROCESS_NUM=4
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+OUT_FILE="${OUT_DIR}/convergence.txt"
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+for mode in "-D SIM_CONV_ANY" "" \
+    "-D SIM_CONV_TOL=1e-5 -D SIM_CONV_TOL_MAX_DELTA_F=0.5"
+do
+    mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_LIB_LINK -fopenmp \
+        -D SIM_CONVERGENCE $mode
+
+    for fishAmount in 200 2000 1000000 100000000
+    do
+        srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+            $C_FILE_NAME $fishAmount $SHORT_STEPS $SEED >> $OUT_FILE
+    done
+
+    srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+        $C_FILE_NAME $LONG_FISH $LONG_STEPS $SEED >> $OUT_FILE
+done
+
+grep "fish_amount\|convergence" $OUT_FILE
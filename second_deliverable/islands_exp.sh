@@ -0,0 +1,46 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=4
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Compare the throughput of the island model against one giant lake with the 
+# same total amount of fishes. A single lake is the giant lake, shared by 
+# every process. With 4 processes and 128 threads, 512 lakes and more give 
+# every thread its own lakes, which step without any communication.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_islands"
+
+OUT_DIR="exp_data"
+
+SIM_STEPS=100
+SEED=5507
+PROCESS_NUM=4
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+OUT_FILE="${OUT_DIR}/islands_${SIM_STEPS}.txt"
+
+mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_LIB_LINK -fopenmp
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+for fishAmount in 1000000 10000000 100000000
+do
+    for lakes in 1 2 4 64 512 2048 8192
+    do
+        srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+            $C_FILE_NAME $fishAmount $SIM_STEPS $lakes $SEED >> $OUT_FILE
+    done
+done
+
+grep "fish_amount\|islands" $OUT_FILE
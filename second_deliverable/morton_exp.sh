@@ -0,0 +1,50 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=2
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Compare the cost of the Morton reordering, amortised over the reorder
+# interval, against the time of the passes with the reordered fishes. The
+# statistics are collected every step, without the overhead bound, as the
+# occupancy grid is the locality sensitive aggregation, and the counters give
+# the per phase times and misses.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+GCC_OPTIONS="${GCC_LIB_LINK} -D SIM_STATS -D SIM_STATS_INTERVAL=1 \
+    -D SIM_STATS_MAX_OVERHEAD=1 -D PERF_COUNTERS"
+
+OUT_DIR="exp_data"
+
+FISH_AMOUNT=25000000
+SIM_STEPS=100
+PROCESS_NUM=2
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+OUT_FILE="${OUT_DIR}/morton_${FISH_AMOUNT}_${SIM_STEPS}.txt"
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+# Without the reordering as the baseline. The reordering swims with the per
+# fish random streams, so the baseline does too and only the order differs.
+mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_OPTIONS -fopenmp -D PER_FISH_RNG
+srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+    $C_FILE_NAME $FISH_AMOUNT $SIM_STEPS >> $OUT_FILE
+
+for reorderSteps in 1 5 10 25 50
+do
+    mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_OPTIONS -fopenmp \
+        -D MORTON_REORDER -D MORTON_REORDER_STEPS=$reorderSteps
+    srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+        $C_FILE_NAME $FISH_AMOUNT $SIM_STEPS >> $OUT_FILE
+done
@@ -0,0 +1,113 @@
+/**
+ * @file reduce_bench.c
+ *
+ * Measures the latency of the per step reductions done in sim_mpi.c. The flat
+ * MPI_Allreduce is compared against the node aware reduction in
+ * hier_reduce.h using the same payloads as the simulation, the barycentre pair
+ * with MPI_SUM and the max deltaF with MPI_MAX.
+ *
+ * @author Tao Hu
+ */
+
+#include <stdio.h>
+#include <mpi.h>
+
+#include "../lib/hier_reduce.h"
+
+#define BENCH_ITERATIONS 10000
+#define BENCH_WARMUP_ITERATIONS 100
+#define MASTER_RANK 0
+
+/**
+ * Performs one simulation step worth of reductions, either flat or through
+ * the node aware reduction.
+ *
+ * @param hierReduce the node aware reduction state, NULL for flat
+ * @param barycenterVals the barycentre pair, reduced in place
+ * @param maxDeltaf the max deltaF, reduced in place
+ */
+static void bench_step_reductions(
+    HierReduce* hierReduce,
+    float* barycenterVals,
+    float* maxDeltaf) {
+    float globalBarycenterVals[2];
+    float globalMaxDeltaf;
+
+    if (hierReduce == NULL) {
+        MPI_Allreduce(barycenterVals, globalBarycenterVals, 2, MPI_FLOAT,
+            MPI_SUM, MPI_COMM_WORLD);
+        MPI_Allreduce(maxDeltaf, &globalMaxDeltaf, 1, MPI_FLOAT, MPI_MAX,
+            MPI_COMM_WORLD);
+    } else {
+        hier_reduce_allreduce(hierReduce, barycenterVals, globalBarycenterVals,
+            2, MPI_SUM);
+        hier_reduce_allreduce(hierReduce, maxDeltaf, &globalMaxDeltaf, 1,
+            MPI_MAX);
+    }
+
+    // Keep the values bounded so the reductions do not overflow
+    barycenterVals[0] = globalBarycenterVals[0] / 2.0f;
+    barycenterVals[1] = globalBarycenterVals[1] / 2.0f;
+    *maxDeltaf = globalMaxDeltaf / 2.0f;
+}
+
+/**
+ * Times the average latency of one step worth of reductions in micro seconds.
+ * The slowest rank defines the latency.
+ *
+ * @param hierReduce the node aware reduction state, NULL for flat
+ * @param pRank the rank of this process
+ *
+ * @return the average latency in micro seconds
+ */
+static double bench_latency(HierReduce* hierReduce, int pRank) {
+    float barycenterVals[2] = {(float) pRank, 1.0f};
+    float maxDeltaf = (float) pRank;
+    double start;
+    double localElapsed;
+    double elapsed;
+
+    for (int i = 0; i < BENCH_WARMUP_ITERATIONS; i++) {
+        bench_step_reductions(hierReduce, barycenterVals, &maxDeltaf);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_step_reductions(hierReduce, barycenterVals, &maxDeltaf);
+    }
+    localElapsed = MPI_Wtime() - start;
+
+    MPI_Reduce(&localElapsed, &elapsed, 1, MPI_DOUBLE, MPI_MAX, MASTER_RANK,
+        MPI_COMM_WORLD);
+
+    return elapsed / BENCH_ITERATIONS * 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    HierReduce* hierReduce;
+    int pRank;
+    int wSize;
+    double flatLatency;
+    double hierLatency;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &wSize);
+
+    hierReduce = hier_reduce_new(MPI_COMM_WORLD);
+
+    flatLatency = bench_latency(NULL, pRank);
+    hierLatency = bench_latency(hierReduce, pRank);
+
+    if (pRank == MASTER_RANK) {
+        printf("num_of_processes=%d, num_of_nodes=%d, flat_latency_us=%f, "
+            "hier_latency_us=%f\n", wSize, hierReduce->nodeCount,
+            flatLatency, hierLatency);
+    }
+
+    hier_reduce_free(hierReduce);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --nodes=1
+#SBATCH --ntasks=64
+#SBATCH --cpus-per-task=1
+#SBATCH --exclusive
+#SBATCH --time=00:10:00
+
+# Benchmark the flat MPI_Allreduce against the node aware reduction on a single
+# machine with 2 to 64 processes.
+
+GCC_LIB_LINK='-lm'
+GCC_OPTIONS="${GCC_LIB_LINK}"
+C_FILE_NAME="reduce_bench"
+
+OUT_DIR="exp_data"
+OUT_FILE="${OUT_DIR}/reduce_bench.txt"
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_OPTIONS
+
+for processes in 2 4 8 16 32 64
+do
+    srun -N 1 -n $processes -c 1 $C_FILE_NAME >> $OUT_FILE
+done
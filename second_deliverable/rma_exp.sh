@@ -0,0 +1,51 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=4
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Compare collecting the final fishes with MPI_Gatherv against pulling them 
+# with one sided MPI, both writing them to a file on the master. Both builds
+# initialise the fishes on every process, so the master never holds the whole
+# school before the collect. The collect records give the time of the master
+# and of the slowest process, the bytes the master held for the collection and
+# the peak memory of the master and of the largest process.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+COLLECT_FILE="fishes.bin"
+
+OUT_DIR="exp_data"
+
+SIM_STEPS=10
+SEED=5507
+PROCESS_NUM=4
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+OUT_FILE="${OUT_DIR}/rma_gather_${SIM_STEPS}.txt"
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+for method in "-D LOCAL_INIT" "-D RMA_GATHER"
+do
+    mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_LIB_LINK -fopenmp $method \
+        -D COLLECT_FILE=\"$COLLECT_FILE\"
+
+    for fishAmount in 1000000 10000000 25000000 100000000
+    do
+        srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+            $C_FILE_NAME $fishAmount $SIM_STEPS $SEED >> $OUT_FILE
+    done
+done
+
+rm -f $COLLECT_FILE
+grep "fish_amount\|collect" $OUT_FILE
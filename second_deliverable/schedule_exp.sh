@@ -0,0 +1,51 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=2
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Head to head comparison of the work stealing scheduler against the three OMP
+# loop schedules with 2 to 128 threads. The output has the same format as
+# standard_exp.sh so raw_to_csv.sh can be used on it.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+
+OUT_DIR="exp_data"
+OUT_DIR_CSV="${OUT_DIR}_csv"
+
+# A fish amount small enough for the dynamic schedule to finish in time
+FISH_AMOUNT=2500000
+SIM_STEPS=100
+PROCESS_NUM=2
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+if [[ ! -d "$OUT_DIR_CSV" ]]
+then
+    mkdir $OUT_DIR_CSV
+fi
+
+OUT_FILE="${OUT_DIR}/schedule_${FISH_AMOUNT}_${SIM_STEPS}.txt"
+
+for schedule in S_STATIC S_GUIDED S_DYNAMIC S_WORKSTEAL
+do
+    mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_LIB_LINK -D $schedule -fopenmp
+
+    for threads in 2 4 8 16 32 64 128
+    do
+        export OMP_NUM_THREADS=$threads
+        srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+            $C_FILE_NAME $FISH_AMOUNT $SIM_STEPS >> $OUT_FILE
+    done
+done
+
+chmod u+x raw_to_csv.sh
+./raw_to_csv.sh $OUT_FILE "${OUT_DIR_CSV}/schedule_${FISH_AMOUNT}_${SIM_STEPS}.txt.csv"
@@ -0,0 +1,75 @@
+#!/bin/bash
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=2
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Compare the time to the first step of a cold srun launch per configuration 
+# against the jobs of a single simulation server. Both are measured from the
+# moment the run is requested: the cold launch from the srun call, through the
+# wall clock time of its first step, and the server from receiving each job.
+# Both initialise the fishes on every process from the seed, so the difference
+# is the launch and the memory the server keeps mapped between the jobs.
+# The launch records also keep the wall time of the whole srun.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+SERVER_FILE_NAME="sim_mpi_server"
+
+OUT_DIR="exp_data"
+
+# The configurations of the standard experiments, limited to keep within time
+EXP_INSTRUCTION_FILE="exp_instructions.txt"
+MAX_FISH_AMOUNT=25000000
+SEED=5507
+PROCESS_NUM=2
+THREAD_NUM=128
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+COLD_FILE="${OUT_DIR}/server_cold.txt"
+WARM_FILE="${OUT_DIR}/server_warm.txt"
+JOB_FILE="${OUT_DIR}/server_jobs.txt"
+
+mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_LIB_LINK -fopenmp -D LOCAL_INIT
+mpicc "${C_FILE_NAME}.c" -o $SERVER_FILE_NAME $GCC_LIB_LINK -fopenmp -D SIM_SERVER
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+rm -f $JOB_FILE
+for line in $(cat $EXP_INSTRUCTION_FILE)
+do
+    fishAmount=$(echo $line | cut -d ',' -f 1)
+    steps=$(echo $line | cut -d ',' -f 2)
+
+    if [[ $fishAmount -gt $MAX_FISH_AMOUNT ]]
+    then
+        continue
+    fi
+
+    echo "fish_amount=${fishAmount} steps=${steps} seed=${SEED}" >> $JOB_FILE
+
+    launchStart=$(date +%s.%N)
+    output=$(srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+        $C_FILE_NAME $fishAmount $steps $SEED)
+    launchEnd=$(date +%s.%N)
+    echo "$output" >> $COLD_FILE
+
+    firstStep=$(echo "$output" | grep "^startup" | sed 's/.*first_step_epoch=//')
+    echo "launch wall_time=$(echo "$launchEnd - $launchStart" | bc), \
+time_to_first_step=$(echo "$firstStep - $launchStart" | bc)" >> $COLD_FILE
+done
+
+# Only the job records are written to stdout, the logs go to stderr
+srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+    $SERVER_FILE_NAME $JOB_FILE >> $WARM_FILE
+
+grep "startup\|launch" $COLD_FILE
+grep "^job" $WARM_FILE
@@ -0,0 +1,159 @@
+/**
+ * @file sim_islands.c
+ *
+ * Performs the fish school search simulation as an island model. The school
+ * is split into many smaller lakes that evolve independently and every
+ * MIGRATION_STEPS steps the heaviest fish of every lake migrates to the next
+ * lake, see island_model.h. With a single lake it is the simulation of one
+ * giant lake, the reference the throughput of the islands is compared with.
+ *
+ * @author Tao Hu
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <mpi.h>
+#include <omp.h>
+
+#include "../lib/fish_lake.h"
+#include "../lib/sim_util.h"
+#include "../lib/mpi_util.h"
+#include "../lib/arena.h"
+#include "../lib/island_model.h"
+
+#define SIMULATION_STEPS 10
+#define FISH_LAKE_WIDTH 200.0f
+#define FISH_LAKE_HEIGHT 200.0f
+#define MASTER_RANK 0
+
+// The steps between two migrations
+#ifndef MIGRATION_STEPS
+    #define MIGRATION_STEPS 10
+#endif
+
+int main(int argc, char *argv[])
+{
+    Arena* arena;
+    IslandModel* islandModel;
+
+    // The global amount of fishes, split over the lakes
+    int fishAmount;
+    int simulationSteps = SIMULATION_STEPS;
+    int lakes = 1;
+    unsigned int randSeed = time(NULL);
+
+    double start;
+    double elapsed_secs;
+    // The lowest and highest barycentre of the lakes in the last step, the
+    // highest negated so both are reduced with MPI_MIN
+    float localBarycentres[2];
+    float barycentres[2];
+
+    int pRank;
+    int wSize;
+
+    if (argc < 2) {
+        printf("Usage: ./sim_islands <fish amount> [steps] [lakes] [seed]\n");
+        return 1;
+    }
+
+    fishAmount = atoi(argv[1]);
+    if (fishAmount <= 0) {
+        printf("Invalid fish amount as argument\n");
+        return 1;
+    }
+    if (argc >= 3 && atoi(argv[2]) > 0) {
+        simulationSteps = atoi(argv[2]);
+    }
+    if (argc >= 4) {
+        lakes = atoi(argv[3]);
+    }
+    if (argc >= 5) {
+        randSeed = (unsigned int) atoi(argv[4]);
+    }
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &wSize);
+
+    mpi_util_init_all_types();
+    arena = arena_new(ARENA_PAGE_2MB);
+
+    // Every process must start from the same school
+    MPI_Bcast(&randSeed, 1, MPI_UNSIGNED, MASTER_RANK, MPI_COMM_WORLD);
+
+    islandModel = island_model_new(
+        arena,
+        MPI_COMM_WORLD,
+        fishAmount,
+        lakes,
+        FISH_LAKE_WIDTH,
+        FISH_LAKE_HEIGHT,
+        randSeed);
+    if (islandModel == NULL) {
+        if (pRank == MASTER_RANK) {
+            printf("Require at least one fish per lake and the lakes to be a "
+                "multiple or a divisor of the %d processes\n", wSize);
+        }
+        arena_free(arena);
+        mpi_util_free_all_types();
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (pRank == MASTER_RANK) {
+        printf("Program running with %d processes and %d lakes\n", wSize,
+            lakes);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = omp_get_wtime();
+
+    for (int i = 0; i < simulationSteps; i++) {
+        island_model_step(islandModel, randSeed, i);
+
+        // A single lake is the plain simulation, it never migrates
+        if (lakes > 1 && (i + 1) % MIGRATION_STEPS == 0
+            && i + 1 < simulationSteps) {
+            island_model_migrate(islandModel, MPI_SIM_FISH, MPI_COMM_WORLD);
+        }
+    }
+
+    // The slowest process defines the time
+    MPI_Barrier(MPI_COMM_WORLD);
+    elapsed_secs = omp_get_wtime() - start;
+
+    localBarycentres[0] = islandModel->barycentres[0];
+    localBarycentres[1] = -islandModel->barycentres[0];
+    for (int l = 1; l < islandModel->lakeCount; l++) {
+        localBarycentres[0] = min_float(
+            localBarycentres[0],
+            islandModel->barycentres[l]);
+        localBarycentres[1] = min_float(
+            localBarycentres[1],
+            -islandModel->barycentres[l]);
+    }
+    MPI_Reduce(localBarycentres, barycentres, 2, MPI_FLOAT, MPI_MIN,
+        MASTER_RANK, MPI_COMM_WORLD);
+
+    if (pRank == MASTER_RANK) {
+        printf("fish_amount=%d, simulation_steps=%d, num_of_processes=%d, "
+            "num_of_threads=%d, schedule=static, time_taken=%f\n",
+            fishAmount, simulationSteps, wSize, omp_get_max_threads(),
+            elapsed_secs);
+        printf("islands lakes=%d, processes_per_lake=%d, lake_per_thread=%d, "
+            "migration_steps=%d, migrations=%d, fish_steps_per_second=%e, "
+            "min_barycentre=%f, max_barycentre=%f\n", lakes,
+            islandModel->groupSize, islandModel->lakePerThread,
+            MIGRATION_STEPS, islandModel->migrations,
+            (double) fishAmount * simulationSteps / elapsed_secs,
+            barycentres[0], -barycentres[1]);
+    }
+
+    island_model_free(islandModel);
+    arena_free(arena);
+
+    mpi_util_free_all_types();
+    MPI_Finalize();
+    return 0;
+}
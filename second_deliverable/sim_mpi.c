@@ -19,52 +19,433 @@
 #include "../lib/sim_util.h"
 #include "../lib/work_parition.h"
 #include "../lib/mpi_util.h"
+#include "../lib/hier_reduce.h"
+#include "../lib/perf_counter.h"
+#include "../lib/arena.h"
+#include "../lib/sim_stats.h"
+#include "../lib/tile_scheduler.h"
+#include "../lib/morton.h"
+#include "../lib/fish_compact.h"
+#include "../lib/convergence.h"
+#include "../lib/sim_server.h"
+#include "../lib/sim_reference.h"
+#include "../lib/rma_gather.h"
+#include "../lib/trace.h"
 
 #define SIMULATION_STEPS 10
 #define FISH_LAKE_WIDTH 200.0f
 #define FISH_LAKE_HEIGHT 200.0f
 
-#if defined(S_DYNAMIC)
+// With SIM_SERVER the process runs every job read from the address given as
+// the only argument, and the schedule of each job is set at runtime
+#if defined(SIM_SERVER) && (defined(S_DYNAMIC) || defined(S_GUIDED) \
+    || defined(S_WORKSTEAL))
+    #error "SIM_SERVER takes the schedule from the jobs"
+#endif
+
+#if defined(SIM_SERVER) && defined(SIM_COMPACT)
+    #error "SIM_SERVER initialises full precision fishes"
+#endif
+
+#if defined(SIM_SERVER) && defined(SIM_VERIFY)
+    #error "SIM_VERIFY needs the fishes gathered on the master"
+#endif
+
+#if defined(RMA_GATHER) && defined(SIM_VERIFY)
+    #error "SIM_VERIFY compares the fishes gathered with MPI_Gatherv"
+#endif
+
+// With LOCAL_INIT every process initialises its own fishes from the seeded
+// random streams, see fish_lake_init_fishes_seeded, instead of the master
+// initialising all of them and scattering, so the master never holds the whole
+// school before the fishes are collected. The server and the RMA collect
+// always do, the latter so the master only ever holds a chunk of the fishes.
+#if defined(SIM_SERVER) || defined(RMA_GATHER)
+    #define LOCAL_INIT
+#endif
+
+#if defined(LOCAL_INIT) && defined(SIM_VERIFY)
+    #error "SIM_VERIFY needs the fishes initialised on the master"
+#endif
+
+#if defined(SIM_COMPACT) && defined(BOUNDARY_WRAP)
+    #error "The compact deltaF cannot hold the jump of a wrapped fish"
+#endif
+
+#if defined(SIM_SERVER)
+    #define S_METHOD runtime
+    #define S_METHOD_STR SIM_SCHEDULE_NAMES[job->schedule]
+#elif defined(S_DYNAMIC)
     #define S_METHOD dynamic 
     #define S_METHOD_STR "dynamic"
 #elif defined(S_GUIDED)
     #define S_METHOD guided
     #define S_METHOD_STR "guided"
+#elif defined(S_WORKSTEAL)
+    #define S_METHOD_STR "worksteal"
 #else
     #define S_METHOD static
     #define S_METHOD_STR "static"
 #endif
 
+// Loops i over [0, count) inside a parallel region, sharing the iterations 
+// between the threads of the region by the schedule method. The work stealing
+// scheduler is created for the local fish amount, the only count used.
+#if defined(S_WORKSTEAL)
+    #define SIM_FOR(i, count) \
+        tile_scheduler_begin(tileScheduler); \
+        for (int tileBegin = 0, tileEnd = 0; \
+            tile_scheduler_next(tileScheduler, &tileBegin, &tileEnd); ) \
+            for (int i = tileBegin; i < tileEnd; i++)
+#else
+    #define SIM_FOR(i, count) \
+        _Pragma("omp for schedule(S_METHOD)") \
+        for (int i = 0; i < count; i++)
+#endif
+
+// The pages backing the fish arrays and scratch buffers, falls back to smaller
+// pages when the preferred kind is not available.
+#if defined(HUGE_PAGE_1GB)
+    #define ARENA_PAGE_KIND ARENA_PAGE_1GB
+#elif defined(NO_HUGE_PAGES)
+    #define ARENA_PAGE_KIND ARENA_PAGE_DEFAULT
+#else
+    #define ARENA_PAGE_KIND ARENA_PAGE_2MB
+#endif
+
+// With INCREMENTAL the barycentre sums are updated from the changes made by
+// swim and eat, and only recomputed from every fish once every this many steps
+#ifndef INCREMENTAL_RESYNC_STEPS
+    #define INCREMENTAL_RESYNC_STEPS 10
+#endif
+
+// With SIM_STATS the statistics of the school are collected in the eat pass 
+// and printed once every this many steps
+#ifndef SIM_STATS_INTERVAL
+    #define SIM_STATS_INTERVAL 10
+#endif
+// A sample is skipped while the time spent on the statistics so far is above
+// this fraction of the simulation time, 1 never skips
+#ifndef SIM_STATS_MAX_OVERHEAD
+    #define SIM_STATS_MAX_OVERHEAD 0.05
+#endif
+
+// With MORTON_REORDER the local fishes are sorted by the Morton key of their 
+// position once every this many steps. The swim then draws from a random 
+// stream per fish, so the reordering does not change which fish gets which 
+// random numbers.
+#ifndef MORTON_REORDER_STEPS
+    #define MORTON_REORDER_STEPS 10
+#endif
+
+#if defined(MORTON_REORDER) && defined(SIM_COMPACT)
+    #error "MORTON_REORDER only sorts full precision fishes"
+#endif
+
+// With SIM_VERIFY the master runs the reference engine next to the simulation
+// and compares the values of every step and the final fishes. The fishes are
+// initialised from the seed and swim with the per fish random streams, so the
+// result does not depend on the processes, threads or schedule.
+#if defined(MORTON_REORDER) || defined(SIM_VERIFY)
+    #define PER_FISH_RNG
+#endif
+
+#if defined(MORTON_REORDER)
+    #define SIM_FISH_ID(j) fishIds[j]
+#else
+    #define SIM_FISH_ID(j) (workPartition->offset + (j))
+#endif
+
+// With SIM_CONVERGENCE the simulation stops once the monitored values have 
+// been stable for SIM_CONV_PATIENCE windows of SIM_CONV_WINDOW steps, all of
+// them or with SIM_CONV_ANY any
+#if defined(SIM_CONV_ANY)
+    #define SIM_CONV_ANY_FLAG 1
+    #define SIM_CONV_MODE_STR "any"
+#else
+    #define SIM_CONV_ANY_FLAG 0
+    #define SIM_CONV_MODE_STR "all"
+#endif
+
+// How the local fishes are stored. With SIM_COMPACT every fish takes 16 bytes
+// instead of 24 at reduced precision, and its values are converted on access.
+#if defined(SIM_COMPACT)
+    typedef CompactFish SimFish;
+    #define MPI_SIM_STORAGE_FISH MPI_SIM_COMPACT_FISH
+    #define SIM_FISH_DISTANCE(fish) compact_fish_distance(fish)
+    #define SIM_FISH_WEIGHT(fish) compact_fish_weight(fish)
+    #define SIM_FISH_DELTA_F(fish) compact_fish_delta_f(fish)
+    #define SIM_FISH_MOVE compact_fish_lake_move
+    #define SIM_FISH_SWIM compact_fish_lake_swim
+    #define SIM_FISH_EAT compact_fish_eat
+    #define STORAGE_STR "compact"
+#else
+    typedef Fish SimFish;
+    #define MPI_SIM_STORAGE_FISH MPI_SIM_FISH
+    #define SIM_FISH_DISTANCE(fish) ((fish)->distanceFromOrigin)
+    #define SIM_FISH_WEIGHT(fish) ((fish)->weight)
+    #define SIM_FISH_DELTA_F(fish) ((fish)->deltaF)
+    #define SIM_FISH_MOVE fish_lake_fish_move
+    #define SIM_FISH_SWIM fish_lake_fish_swim
+    #define SIM_FISH_EAT fish_eat
+    #define STORAGE_STR "full"
+#endif
+
+// Reduction clauses the optional features add to the parallel regions
+#if defined(INCREMENTAL)
+    #define INCREMENTAL_SWIM_REDUCTION reduction(+: deltaDistWeight, deltaObjective)
+    #define INCREMENTAL_EAT_REDUCTION reduction(+: deltaDistWeight)
+#else
+    #define INCREMENTAL_SWIM_REDUCTION
+    #define INCREMENTAL_EAT_REDUCTION
+#endif
+
+// With RMA_GATHER the master pulls the final fishes from the window of every 
+// process, this many fishes at a time, instead of MPI_Gatherv. With 
+// COLLECT_FILE the master writes the collected fishes to that file.
+#ifndef RMA_GATHER_CHUNK
+    #define RMA_GATHER_CHUNK (1 << 20)
+#endif
+
+// With SIM_TRACE every thread records the phases, MPI calls and steps, which
+// are written to TRACE_FILE as Chrome trace JSON after the run.
+#ifndef TRACE_FILE
+    #define TRACE_FILE "trace.json"
+#endif
+
+#if defined(RMA_GATHER)
+    #define COLLECT_METHOD_STR "rma"
+#else
+    #define COLLECT_METHOD_STR "gatherv"
+#endif
+
+#if defined(LOCAL_INIT)
+    #define INIT_METHOD_STR "local"
+#else
+    #define INIT_METHOD_STR "master"
+#endif
+
+#if defined(HIER_REDUCE)
+    #define REDUCE_METHOD_STR "hierarchical"
+#else
+    #define REDUCE_METHOD_STR "flat"
+#endif
+
 #define MASTER_RANK 0
 
-int main(int argc, char *argv[])
+#if defined(HIER_REDUCE)
+// Node aware reduction state, created once after MPI_Init
+static HierReduce* hierReduce;
+#endif
+
+#if defined(PERF_COUNTERS)
+// Hardware counters of every thread of this process
+static PerfCounters* perfCounters;
+#endif
+
+#if defined(SIM_TRACE)
+// The events of every thread of this process, created for every run
+static Tracer* tracer;
+#endif
+
+#if defined(S_WORKSTEAL)
+// Schedules the tiles of the local fishes, created once the local fish amount
+// is known
+static TileScheduler* tileScheduler;
+#endif
+
+/**
+ * Allreduce of floats over MPI_COMM_WORLD. Compiled with HIER_REDUCE the 
+ * reduction is first done within the node through shared memory and only the
+ * node leaders take part in the inter-node MPI_Allreduce.
+ *
+ * @param sendBuf the local values
+ * @param recvBuf receives the reduced values
+ * @param count the amount of values
+ * @param op the reduction operation
+ */
+static void sim_allreduce(float* sendBuf, float* recvBuf, int count, MPI_Op op) {
+    TRACE_BEGIN(tracer, TRACE_ALLREDUCE);
+#if defined(HIER_REDUCE)
+    hier_reduce_allreduce(hierReduce, sendBuf, recvBuf, count, op);
+#else
+    MPI_Allreduce(sendBuf, recvBuf, count, MPI_FLOAT, op, MPI_COMM_WORLD);
+#endif
+    TRACE_END(tracer, TRACE_ALLREDUCE);
+}
+
+/**
+ * Prints the kind of pages used and the time and page faults of the first 
+ * step against the steady state steps on the master rank. The slowest process
+ * defines the times and the page faults are summed over all processes.
+ * Collective over MPI_COMM_WORLD.
+ *
+ * @param arena the arena of this process
+ * @param firstStepTime the duration of the first step
+ * @param steadyStepTime the average duration of the remaining steps
+ * @param firstStepFaults the page faults during the first step
+ * @param steadyFaults the page faults during the remaining steps
+ */
+static void sim_report_memory(
+    Arena* arena,
+    double firstStepTime,
+    double steadyStepTime,
+    long firstStepFaults,
+    long steadyFaults) {
+    double localTimes[2] = {firstStepTime, steadyStepTime};
+    double times[2];
+    long localFaults[2] = {firstStepFaults, steadyFaults};
+    long faults[2];
+    int localPageKind = arena->worstPageKind;
+    int pageKind;
+    int pRank;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    MPI_Reduce(localTimes, times, 2, MPI_DOUBLE, MPI_MAX, MASTER_RANK,
+        MPI_COMM_WORLD);
+    MPI_Reduce(localFaults, faults, 2, MPI_LONG, MPI_SUM, MASTER_RANK,
+        MPI_COMM_WORLD);
+    // An arena without blocks holds the most preferred kind, which MPI_MAX
+    // ignores, so only the pages actually mapped are reported
+    MPI_Reduce(&localPageKind, &pageKind, 1, MPI_INT, MPI_MAX, MASTER_RANK,
+        MPI_COMM_WORLD);
+
+    if (pRank == MASTER_RANK) {
+        printf("memory page_kind=%s, first_step_time=%f, steady_step_time=%f, "
+            "first_step_page_faults=%ld, steady_page_faults=%ld\n", 
+            ARENA_PAGE_KIND_NAMES[pageKind], times[0], times[1], faults[0],
+            faults[1]);
+    }
+}
+
+#if !defined(SIM_SERVER)
+/**
+ * Writes collected fishes to the file given as the context, if any, at the
+ * place of their global index so the chunks may arrive in any order. See 
+ * RmaGatherSink.
+ */
+static void sim_write_fishes(
+    const void* fishes,
+    int offset,
+    int count,
+    void* context) {
+    if (context != NULL) {
+        fseek((FILE*) context, (long) offset * (long) sizeof(SimFish),
+            SEEK_SET);
+        fwrite(fishes, sizeof(SimFish), count, (FILE*) context);
+    }
+}
+
+/**
+ * Prints how long collecting the final fishes took on the master and on the
+ * slowest process, the bytes the master held for it, the peak memory of the
+ * master and the largest peak memory of any process. The peak memory covers
+ * the whole run, including the initialisation of the fishes. Collective over
+ * MPI_COMM_WORLD.
+ *
+ * @param collectTime the time this process spent collecting
+ * @param bufferBytes the bytes held by the master to collect the fishes
+ */
+static void sim_report_collect(double collectTime, size_t bufferBytes) {
+    double maxCollectTime;
+    struct rusage usage;
+    long maxProcessRss;
+    int pRank;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    getrusage(RUSAGE_SELF, &usage);
+    MPI_Reduce(&collectTime, &maxCollectTime, 1, MPI_DOUBLE, MPI_MAX,
+        MASTER_RANK, MPI_COMM_WORLD);
+    MPI_Reduce(&usage.ru_maxrss, &maxProcessRss, 1, MPI_LONG, MPI_MAX,
+        MASTER_RANK, MPI_COMM_WORLD);
+
+    if (pRank == MASTER_RANK) {
+        printf("collect method=%s, init=%s, master_time=%f, "
+            "max_process_time=%f, buffer_bytes=%zu, max_rss_kb=%ld, "
+            "max_process_rss_kb=%ld\n", COLLECT_METHOD_STR, INIT_METHOD_STR,
+            collectTime, maxCollectTime, bufferBytes, usage.ru_maxrss,
+            maxProcessRss);
+    }
+}
+#endif
+
+/**
+ * Runs a simulation of the job on every process and prints its reports on the
+ * master. Collective over MPI_COMM_WORLD, every process must give the same job.
+ *
+ * @param arena the arena of this process, serves every allocation of the run
+ * @param job the job to run
+ * @param readyTime the time the run was requested at
+ * @param result receives the result of the run, meaningful on the master
+ */
+static void sim_run(
+    Arena* arena,
+    const SimJob* job,
+    double readyTime,
+    SimResult* result)
 {
+#if !defined(LOCAL_INIT)
     // The fishlake containing all fishes, global
-    FishLake* fishLake;
+    FishLake* fishLake = NULL;
+#endif
+#if !defined(SIM_SERVER) && !defined(RMA_GATHER)
+    // Substitution for fishlake->fishes, the worker processes do not intialise 
+    // fishLake. Hence no access to fishLake->fishes when using Gatherv
+    SimFish* allFishes = NULL;
+#endif
     // The fishlake containg a subset of all fishes, used by worker processes, 
     // local
     FishLake* localFishLake;
-    // Substitution for fishlake->fishes, the worker processes do not intialise 
-    // fishLake. Hence no access to fishLake->fishes when using Gatherv
-    Fish* allFishes;
+#if defined(SIM_COMPACT)
+    // The local fishes, the local fish lake only provides the bounds
+    CompactFish* localCompactFishes;
+#endif
     WorkPartition* workPartition;
 
     // The global amount of fishes
-    int fishAmount = atoi(argv[1]);
+    int fishAmount = job->fishAmount;
     // Number of times the simulation will run
-    int simulationSteps = SIMULATION_STEPS;
+    int simulationSteps = job->simulationSteps;
+    // Number of steps actually ran, fewer than simulationSteps if converged
+    int stepsRun = 0;
     // The seed to be used
-    unsigned int randSeed = time(NULL);
+    unsigned int randSeed = job->seed;
+#if defined(PER_FISH_RNG)
+    // The seed of the per fish random streams, same on every process
+    unsigned int fishSeed;
+#endif
+
+#if defined(MORTON_REORDER)
+    // The original, global, id of each local fish
+    int* fishIds;
+    MortonSorter* mortonSorter;
+    double sortTime = 0;
+    int sorts = 0;
+#endif
     // Start time of simulation
     double start;
     // End time of simulation
     double end;
     // Duration of the simulation
     double elapsed_secs;
+    // Start of the first simulation step and the end of it
+    double firstStepStart = 0;
+    double firstStepEnd = 0;
+    // Page faults of this process before and after the first step and at the 
+    // end of the simulation
+    long pageFaults[3] = {0, 0, 0};
+#if !defined(SIM_SERVER)
+    // Collecting the final fishes on the master, the bytes the master holds
+    // for it and the file it writes them to
+    double collectStart;
+    double collectTime;
+    size_t collectBytes = 0;
+    FILE* collectFile = NULL;
+#endif
     // The final calculated barycentre
-    float barycentre;
+    float barycentre = 0.0f;
     // Used for easier access, instead of using localLake->fishes
-    Fish* fishes;
+    SimFish* fishes;
     // Used by OMP to calculated the local objective value
     float objectiveValue;
     // Used by OMP to calculate the local sum of distance * weight
@@ -77,9 +458,63 @@ int main(int argc, char *argv[])
     // all processes through a single MPI_Allreduce call.
     
     // Represents the numerator and the denominator of the barycentre equation. 
-    // The first value is numerator the second value is the denominator
-    float globalBarycenterVals[2];
-    float localBarycenterVals[2];
+    // The first value is numerator the second value is the denominator. With 
+    // INCREMENTAL the last two values carry the incremental sums when they are
+    // resynchronised, so the drift is found in the same MPI call.
+    float globalBarycenterVals[4];
+    float localBarycenterVals[4];
+    // Whether the barycentre sums are recomputed from every fish in this step
+    int fullRecompute;
+
+#if defined(INCREMENTAL)
+    // The local sums of dfo * weight and dfo, same order as 
+    // localBarycenterVals, kept up to date from the changes of swim and eat,
+    // zero until the first step computes them from every fish
+    double incrementalSums[2] = {0.0, 0.0};
+    // The changes to the sums made by swim and eat in the current step
+    double deltaDistWeight;
+    double deltaObjective;
+    // The largest relative difference between the incremental and the full 
+    // global sums seen at a resynchronisation
+    float maxDrift[2] = {0.0f, 0.0f};
+#endif
+
+#if defined(SIM_STATS)
+    // The statistics of the local fishes and of all fishes in this step
+    SimStats stepStats;
+    SimStats globalStats;
+    // The statistics every thread collects in a sampling step, merged into
+    // stepStats after the eat pass
+    SimThreadStats* threadStats;
+    int statsThreads;
+    // Whether the statistics are collected in this step
+    int statsStep;
+    // Time of the eat pass with and without the statistics and the time of 
+    // reducing the statistics, used to find the overhead
+    double eatStart;
+    double statsEatTime = 0;
+    double plainEatTime = 0;
+    double statsReduceTime = 0;
+    int statsSteps = 0;
+    int plainSteps = 0;
+    // The time spent on the statistics so far as seen by the master, and the
+    // samples skipped to keep it within SIM_STATS_MAX_OVERHEAD
+    double statsCost = 0;
+    int statsSkipped = 0;
+#endif
+
+#if defined(SIM_VERIFY)
+    // The reference engine, on the master only
+    SimReference* simReference = NULL;
+    float verifyValues[SIM_REF_VALUE_COUNT];
+#endif
+
+#if defined(SIM_CONVERGENCE)
+    Convergence convergence;
+    float convValues[CONV_CRITERION_COUNT];
+    // The criterion that stopped the simulation, -1 if it ran every step
+    int convCriterion = -1;
+#endif
 
     float globalMaxDeltaf;
     float localMaxDeltaf;
@@ -87,57 +522,43 @@ int main(int argc, char *argv[])
     int pRank;
     int wSize;
 
-    // Since the number of fishes are allocated on the heap at runtime, fish 
-    // amount can be dynamic. It would be easier to run the expirement with 
-    // the fish amount variable as an program argument.
-    if (argc < 2) {
-        printf("Require fish amount as the only argument\n Usage: \
-         ./simulation_sequential <fish amount>\n");
-        return 1;
-    }
-
-    if (fishAmount <= 0) {
-        printf("Invalid fish amount as argument\n");
-        return 1;
-    }
-
-    if (argc >= 3) {
-        int argSimulationSteps = atoi(argv[2]);
-        if (argSimulationSteps > 0) {
-            simulationSteps = argSimulationSteps;
-        }
-    }
-
-    MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
     MPI_Comm_size(MPI_COMM_WORLD, &wSize);
 
-    // Initialise the custom data types with MPI
-    mpi_util_init_all_types();
-
-    if (wSize < 2) {
-        printf("Program requires at least 2 processes\n");
-        return 1;
-    }
-    
     // The master process intialises all the fishes.
     if (pRank == MASTER_RANK) {
         printf("Program running with %d processes\n", wSize);
-        
+        printf("Reductions are performed with %s method\n", REDUCE_METHOD_STR);
+        printf("Moves out of the lake are bounded with %s policy\n",
+            FISH_LAKE_BOUNDARY_STR);
+
+#if !defined(LOCAL_INIT)
         // Intialising all the fishes
-        fishLake = fish_lake_new(
+        fishLake = fish_lake_arena_new(
+            arena,
             fishAmount, 
             FISH_LAKE_WIDTH, 
             FISH_LAKE_HEIGHT);
+#if defined(SIM_VERIFY)
+        fish_lake_init_fishes_seeded(fishLake, randSeed, 0);
+#else
         fish_lake_init_fishes(fishLake);
+#endif
         printf("Initialised the fish lake\n");
-
+#endif
     }
 
     printf("Process %d is running with %d thread\n", pRank, omp_get_max_threads());
+#if defined(SIM_TRACE)
+    // Aligns the clocks before the simulation is timed
+    tracer = trace_new(MPI_COMM_WORLD, MASTER_RANK);
+#endif
     start = omp_get_wtime();
     // Create the work parition information
     workPartition = work_parition_new(wSize, fishAmount, pRank);
+    // The default seed is the time each process started at, every process
+    // must initialise and swim from the seed of the master
+    MPI_Bcast(&randSeed, 1, MPI_UNSIGNED, MASTER_RANK, MPI_COMM_WORLD);
     if (pRank == MASTER_RANK) {
         for (int i = 0; i < workPartition->paritionCount; i++)
         {
@@ -146,8 +567,76 @@ int main(int argc, char *argv[])
         }
     }
 
+#if defined(LOCAL_INIT)
+    // Every process initialises its own fishes in parallel, so there is no 
+    // global lake to scatter
+#if defined(SIM_COMPACT)
+    localFishLake = fish_lake_arena_new(
+        arena,
+        0, 
+        FISH_LAKE_WIDTH, 
+        FISH_LAKE_HEIGHT);
+    localCompactFishes = (CompactFish*) arena_alloc(
+        arena,
+        (size_t) workPartition->size * sizeof(CompactFish),
+        ARENA_MIN_ALIGN);
+    {
+        // Initialised at full precision and packed, the full fishes are only
+        // held for as long as it takes
+        FishLake* initLake = fish_lake_new(
+            workPartition->size,
+            FISH_LAKE_WIDTH,
+            FISH_LAKE_HEIGHT);
+
+        fish_lake_init_fishes_seeded(
+            initLake,
+            randSeed,
+            workPartition->offset);
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < workPartition->size; k++) {
+            compact_fish_pack(&(localCompactFishes[k]), &(initLake->fishes[k]));
+        }
+        fish_lake_free(initLake);
+    }
+#else
+    localFishLake = fish_lake_arena_new(
+        arena,
+        workPartition->size, 
+        FISH_LAKE_WIDTH, 
+        FISH_LAKE_HEIGHT);
+    fish_lake_init_fishes_seeded(
+        localFishLake,
+        randSeed,
+        workPartition->offset);
+#endif
+#else
+#if defined(SIM_COMPACT)
+    localFishLake = fish_lake_arena_new(
+        arena,
+        0, 
+        FISH_LAKE_WIDTH, 
+        FISH_LAKE_HEIGHT);
+    localCompactFishes = (CompactFish*) arena_alloc(
+        arena,
+        (size_t) workPartition->size * sizeof(CompactFish),
+        ARENA_MIN_ALIGN);
+
+    // The master packs all fishes, so only the compact fishes are sent
+    if (pRank == MASTER_RANK) {
+        allFishes = (CompactFish*) arena_alloc(
+            arena,
+            (size_t) fishAmount * sizeof(CompactFish),
+            ARENA_MIN_ALIGN);
+
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < fishAmount; k++) {
+            compact_fish_pack(&(allFishes[k]), &(fishLake->fishes[k]));
+        }
+    }
+#else
     // Intialise the local fish lake based on the parition size of each process
-    localFishLake = fish_lake_new(
+    localFishLake = fish_lake_arena_new(
+        arena,
         workPartition->size, 
         FISH_LAKE_WIDTH, 
         FISH_LAKE_HEIGHT);
@@ -155,35 +644,116 @@ int main(int argc, char *argv[])
     // Worker process does not intialise the fishLake so fishlake->fishes would 
     // cause memory segmentation fault.
     if (pRank == MASTER_RANK) allFishes = fishLake->fishes;
+#endif
     
     // Scatterv is used to send uneven amount of partitioned data to different 
     // worker processes
+    TRACE_BEGIN(tracer, TRACE_SCATTER);
     MPI_Scatterv(
         allFishes,
         workPartition->sizes,
         workPartition->offsets,
-        MPI_SIM_FISH,
+        MPI_SIM_STORAGE_FISH,
+#if defined(SIM_COMPACT)
+        localCompactFishes,
+#else
         localFishLake->fishes,
+#endif
         workPartition->size,
-        MPI_SIM_FISH,
+        MPI_SIM_STORAGE_FISH,
         MASTER_RANK,
         MPI_COMM_WORLD
     );
+    TRACE_END(tracer, TRACE_SCATTER);
+#endif
 
     // Every process will process the local fishes.
+#if defined(SIM_COMPACT)
+    fishes = localCompactFishes;
+#else
     fishes = localFishLake->fishes;
+#endif
+
+#if defined(S_WORKSTEAL)
+    tileScheduler = tile_scheduler_new(
+        workPartition->size,
+        TILE_SCHEDULER_TILE_SIZE);
+#endif
+
+#if defined(PERF_COUNTERS)
+    // Opened after the scatter so the counters only cover the simulation
+    perfCounters = perf_counters_new();
+#endif
+
+#if defined(PER_FISH_RNG)
+    fishSeed = randSeed;
+#endif
+
+#if defined(SIM_VERIFY)
+    if (pRank == MASTER_RANK) {
+        simReference = sim_reference_new(fishLake, fishSeed);
+    }
+#endif
+
+#if defined(MORTON_REORDER)
+    mortonSorter = morton_sorter_new(arena, workPartition->size);
+    fishIds = (int*) arena_alloc(
+        arena,
+        (size_t) workPartition->size * sizeof(int),
+        ARENA_MIN_ALIGN);
+    for (int k = 0; k < workPartition->size; k++) {
+        fishIds[k] = workPartition->offset + k;
+    }
+#endif
+
+#if defined(SIM_STATS)
+    statsThreads = omp_get_max_threads();
+    threadStats = (SimThreadStats*) arena_alloc(
+        arena,
+        (size_t) statsThreads * sizeof(SimThreadStats),
+        ARENA_MIN_ALIGN);
+#endif
+
     // Just making sure every process gets a different seed.
     randSeed += 500 * pRank;
 
+#if defined(SIM_CONVERGENCE)
+    convergence_init(&convergence);
+#endif
+
     // === Start of simulation ===
 
+    firstStepStart = omp_get_wtime();
+    pageFaults[0] = arena_page_faults();
+
     // The simulation start with t or i = 0 representing the first time step. 
     // But before this, fish are all initialised with random weight and position 
     for (int i = 0; i < simulationSteps; i++)
     {
+        TRACE_BEGIN(tracer, TRACE_STEP);
         objectiveValue = 0;
         sumOfDistWeight = 0;
         localMaxDeltaf = INT32_MIN;
+        fullRecompute = 1;
+
+#if defined(MORTON_REORDER)
+        if (i % MORTON_REORDER_STEPS == 0) {
+            double sortStart = omp_get_wtime();
+
+            TRACE_BEGIN(tracer, TRACE_MORTON_SORT);
+            morton_sorter_sort(mortonSorter, localFishLake, &fishIds);
+            TRACE_END(tracer, TRACE_MORTON_SORT);
+            fishes = localFishLake->fishes;
+            sortTime += omp_get_wtime() - sortStart;
+            sorts++;
+        }
+#endif
+
+#if defined(INCREMENTAL)
+        fullRecompute = i % INCREMENTAL_RESYNC_STEPS == 0;
+        deltaDistWeight = 0;
+        deltaObjective = 0;
+#endif
 
         // calculate barycenter of the fish school. In the real simulation I am 
         // guessing this is needed to find the direction for the fish to swim 
@@ -191,102 +761,651 @@ int main(int argc, char *argv[])
         // each time step. The equation also uses W(t) to represent the fish 
         // weight used in the barycenter calculation. The following eat and swim
         //  will both be producing W(t+1) and Position(t+1)
-        #pragma omp parallel for schedule(S_METHOD) reduction(+: sumOfDistWeight, objectiveValue)
-        for (int i = 0; i < workPartition->size; i++)
-        {
-            sumOfDistWeight += fishes[i].distanceFromOrigin * fishes[i].weight;
-            // calc the value of objective function
-            objectiveValue += fishes[i].distanceFromOrigin;
+        if (fullRecompute) {
+            #pragma omp parallel reduction(+: sumOfDistWeight, objectiveValue)
+            {
+                TRACE_BEGIN(tracer, TRACE_BARYCENTRE);
+                PERF_PHASE_BEGIN(perfCounters);
+
+                SIM_FOR(i, workPartition->size)
+                {
+                    float distance = SIM_FISH_DISTANCE(&(fishes[i]));
+
+                    sumOfDistWeight += distance * SIM_FISH_WEIGHT(&(fishes[i]));
+                    // calc the value of objective function
+                    objectiveValue += distance;
+                }
+
+                PERF_PHASE_END(perfCounters, PERF_PHASE_BARYCENTRE);
+                TRACE_END(tracer, TRACE_BARYCENTRE);
+            }
+        }
+
+#if defined(INCREMENTAL)
+        if (fullRecompute) {
+            localBarycenterVals[0] = sumOfDistWeight;
+            localBarycenterVals[1] = objectiveValue;
+            localBarycenterVals[2] = incrementalSums[0];
+            localBarycenterVals[3] = incrementalSums[1];
+        } else {
+            localBarycenterVals[0] = incrementalSums[0];
+            localBarycenterVals[1] = incrementalSums[1];
         }
 
+        // The incremental sums do not exist yet on the first step
+        sim_allreduce(
+            localBarycenterVals,
+            globalBarycenterVals,
+            fullRecompute && i > 0 ? 4 : 2,
+            MPI_SUM);
+
+        if (fullRecompute) {
+            for (int k = 0; i > 0 && k < 2; k++) {
+                maxDrift[k] = max_float(
+                    maxDrift[k],
+                    fabsf(globalBarycenterVals[k + 2] - globalBarycenterVals[k])
+                        / fabsf(globalBarycenterVals[k]));
+            }
+            incrementalSums[0] = sumOfDistWeight;
+            incrementalSums[1] = objectiveValue;
+        }
+#else
         // Prepare for message passing by storing in localBarycenterVals.
         localBarycenterVals[0] = sumOfDistWeight;
         localBarycenterVals[1] = objectiveValue;
 
         // The barycentre can only be calculated if all the values are available
         //  This is a summation problem, so the MPI_Allreduce can be used.
-        MPI_Allreduce(
-            localBarycenterVals,
-            globalBarycenterVals,
-            2,
-            MPI_FLOAT,
-            MPI_SUM,
-            MPI_COMM_WORLD
-        );
+        sim_allreduce(localBarycenterVals, globalBarycenterVals, 2, MPI_SUM);
+#endif
  
         barycentre = globalBarycenterVals[0] / globalBarycenterVals[1];
 
         // every fish will first swim so deltaF can be calculated
-        #pragma omp parallel firstprivate(randSeed)
+        #pragma omp parallel firstprivate(randSeed) INCREMENTAL_SWIM_REDUCTION
         {
             randSeed += omp_get_thread_num();
+            TRACE_BEGIN(tracer, TRACE_SWIM);
+            PERF_PHASE_BEGIN(perfCounters);
 
-            #pragma omp for schedule(S_METHOD)
-            for (int j = 0; j < workPartition->size; j++) {
+            SIM_FOR(j, workPartition->size) {
                 // The fish will perform the swim action and change the 
                 // position. Delta f is calculated after the change in position 
                 // and is stored as a attribute of the fish.
-                float deltaF = fish_lake_fish_swim(localFishLake, &(fishes[j]), &randSeed);
+                // The change in distance is only needed by the incremental
+                // objective
+#if defined(INCREMENTAL)
+                float deltaDistance =
+#endif
+#if defined(PER_FISH_RNG)
+                // Two draws per fish per step, at counter 2i and 2i + 1
+                SIM_FISH_MOVE(
+                    localFishLake,
+                    &(fishes[j]),
+                    rand_hash_float(fishSeed, SIM_FISH_ID(j), 2 * i, 
+                        FISH_SWIM_MIN, FISH_SWIM_MAX),
+                    rand_hash_float(fishSeed, SIM_FISH_ID(j), 2 * i + 1, 
+                        FISH_SWIM_MIN, FISH_SWIM_MAX));
+#else
+                SIM_FISH_SWIM(localFishLake, &(fishes[j]), &randSeed);
+#endif
+
+#if defined(INCREMENTAL)
+                // The weight is still W(t) at this point
+                deltaDistWeight += deltaDistance * SIM_FISH_WEIGHT(&(fishes[j]));
+                deltaObjective += deltaDistance;
+#endif
             }
+
+            PERF_PHASE_END(perfCounters, PERF_PHASE_SWIM);
+            TRACE_END(tracer, TRACE_SWIM);
         }
 
         // calculate maxDeltaF
-        #pragma omp parallel for schedule(S_METHOD) reduction(max: localMaxDeltaf)
-        for (int i = 0; i < workPartition->size; i++)
+        #pragma omp parallel reduction(max: localMaxDeltaf)
         {
-            localMaxDeltaf = max_float(localMaxDeltaf, fishes[i].deltaF);
+            TRACE_BEGIN(tracer, TRACE_MAX_DELTA_F);
+            PERF_PHASE_BEGIN(perfCounters);
+
+            SIM_FOR(i, workPartition->size)
+            {
+                localMaxDeltaf = max_float(
+                    localMaxDeltaf,
+                    SIM_FISH_DELTA_F(&(fishes[i])));
+            }
+
+            PERF_PHASE_END(perfCounters, PERF_PHASE_MAX_DELTA_F);
+            TRACE_END(tracer, TRACE_MAX_DELTA_F);
         }
 
         // Find the global max deltaf, which is required for fish eat.
-        MPI_Allreduce(
-            &localMaxDeltaf,
-            &globalMaxDeltaf,
-            1,
-            MPI_FLOAT,
-            MPI_MAX,
-            MPI_COMM_WORLD
-        );
+        sim_allreduce(&localMaxDeltaf, &globalMaxDeltaf, 1, MPI_MAX);
+
+#if defined(SIM_VERIFY)
+        if (pRank == MASTER_RANK) {
+            verifyValues[SIM_REF_BARYCENTRE] = barycentre;
+            verifyValues[SIM_REF_OBJECTIVE] = globalBarycenterVals[1];
+            verifyValues[SIM_REF_MAX_DELTA_F] = globalMaxDeltaf;
+            sim_reference_check_step(simReference, verifyValues);
+        }
+#endif
+
+#if defined(PRINT_STEPS)
+        // The global values of every step, to compare trajectories
+        if (pRank == MASTER_RANK) {
+            printf("step step=%d, barycentre=%.9e, objective=%.9e, "
+                "max_delta_f=%.9e\n", i, barycentre, globalBarycenterVals[1],
+                globalMaxDeltaf);
+        }
+#endif
 
         // every fish will eat, which requires maxDeltaF
-        #pragma omp parallel for schedule(S_METHOD)
-        for (int i = 0; i < workPartition->size; i++)
+#if defined(SIM_STATS)
+        // The statistics are of W(t+1) and Position(t+1), both are final once
+        // the fish has eaten. Only in a sampling step every thread collects
+        // its own statistics, which are merged after the parallel region, so
+        // the other steps pay nothing for them. The master decides whether a
+        // due sample fits in the overhead budget, so every process agrees.
+        statsStep = (i + 1) % SIM_STATS_INTERVAL == 0;
+        eatStart = omp_get_wtime();
+        if (statsStep) {
+            if (pRank == MASTER_RANK) {
+                statsStep = statsCost
+                    <= SIM_STATS_MAX_OVERHEAD * (eatStart - start);
+            }
+            MPI_Bcast(&statsStep, 1, MPI_INT, MASTER_RANK, MPI_COMM_WORLD);
+            statsSkipped += !statsStep;
+            for (int t = 0; statsStep && t < statsThreads; t++) {
+                sim_stats_init(&(threadStats[t].stats));
+            }
+        }
+#endif
+        #pragma omp parallel INCREMENTAL_EAT_REDUCTION
         {
-            fish_eat(&(fishes[i]), globalMaxDeltaf);
+#if defined(SIM_STATS)
+            SimStats* ownStats = &(threadStats[omp_get_thread_num()].stats);
+#endif
+            TRACE_BEGIN(tracer, TRACE_EAT);
+            PERF_PHASE_BEGIN(perfCounters);
+
+            SIM_FOR(i, workPartition->size)
+            {
+#if defined(INCREMENTAL)
+                float deltaWeight =
+#endif
+                SIM_FISH_EAT(&(fishes[i]), globalMaxDeltaf);
+
+#if defined(INCREMENTAL)
+                // The dfo is already the one of Position(t+1)
+                deltaDistWeight += SIM_FISH_DISTANCE(&(fishes[i])) * deltaWeight;
+#endif
+
+#if defined(SIM_STATS)
+                if (statsStep) {
+                    sim_stats_add(
+                        ownStats,
+                        SIM_FISH_WEIGHT(&(fishes[i])),
+                        fishes[i].position,
+                        SIM_FISH_DELTA_F(&(fishes[i])),
+                        localFishLake);
+                }
+#endif
+            }
+
+            PERF_PHASE_END(perfCounters, PERF_PHASE_EAT);
+            TRACE_END(tracer, TRACE_EAT);
+        }
+
+#if defined(SIM_STATS)
+        if (statsStep) {
+            double reduceStart;
+
+            // Threads that did not take part hold empty statistics
+            sim_stats_init(&stepStats);
+            for (int t = 0; t < statsThreads; t++) {
+                sim_stats_merge(&stepStats, &(threadStats[t].stats));
+            }
+            reduceStart = omp_get_wtime();
+
+            // The extra time over an average plain eat pass
+            statsEatTime += reduceStart - eatStart;
+            statsCost += reduceStart - eatStart
+                - (plainSteps > 0 ? plainEatTime / plainSteps : 0);
+            statsSteps++;
+            TRACE_BEGIN(tracer, TRACE_STATS_REDUCE);
+            MPI_Reduce(&stepStats, &globalStats, 1, MPI_SIM_STATS,
+                MPI_SIM_STATS_MERGE, MASTER_RANK, MPI_COMM_WORLD);
+            TRACE_END(tracer, TRACE_STATS_REDUCE);
+            if (pRank == MASTER_RANK) {
+                sim_stats_print(&globalStats, i + 1);
+            }
+            statsReduceTime += omp_get_wtime() - reduceStart;
+            statsCost += omp_get_wtime() - reduceStart;
+        } else {
+            plainEatTime += omp_get_wtime() - eatStart;
+            plainSteps++;
         }
+#endif
+
+#if defined(INCREMENTAL)
+        incrementalSums[0] += deltaDistWeight;
+        incrementalSums[1] += deltaObjective;
+#endif
+
+        // The first step pays for the first touch of the pages
+        if (i == 0) {
+            firstStepEnd = omp_get_wtime();
+            pageFaults[1] = arena_page_faults();
+        }
+        stepsRun++;
+        TRACE_END(tracer, TRACE_STEP);
+
+#if defined(SIM_CONVERGENCE)
+        // The values are the global ones every process already has from the 
+        // reductions, so every process stops at the same step
+        convValues[CONV_BARYCENTRE] = barycentre;
+        convValues[CONV_OBJECTIVE] = globalBarycenterVals[1];
+        convValues[CONV_MAX_DELTA_F] = globalMaxDeltaf;
+        convCriterion = convergence_update(
+            &convergence,
+            convValues,
+            SIM_CONV_ANY_FLAG);
+        if (convCriterion >= 0) {
+            break;
+        }
+#endif
     }
 
     // === End of simulation ===
     end = omp_get_wtime();
     elapsed_secs = end - start;
+    pageFaults[2] = arena_page_faults();
 
     if (pRank == MASTER_RANK) {
         printf("fish_amount=%d, simulation_steps=%d, num_of_processes=%d, "
             "num_of_threads=%d, schedule=%s, time_taken=%f\n", 
-            fishAmount, simulationSteps, wSize, omp_get_max_threads(), 
+            fishAmount, stepsRun, wSize, omp_get_max_threads(), 
             S_METHOD_STR, elapsed_secs);
     }
+
+#if defined(SIM_CONVERGENCE)
+    if (pRank == MASTER_RANK) {
+        printf("convergence steps_run=%d, max_steps=%d, criterion=%s, "
+            "mode=%s, window=%d, patience=%d, noise_sigmas=%f\n", stepsRun,
+            simulationSteps,
+            convCriterion >= 0 ? CONV_CRITERION_NAMES[convCriterion] : "none",
+            SIM_CONV_MODE_STR, SIM_CONV_WINDOW, SIM_CONV_PATIENCE,
+            SIM_CONV_NOISE_SIGMAS);
+    }
+#endif
+
+#if defined(INCREMENTAL)
+    if (pRank == MASTER_RANK) {
+        printf("incremental resync_steps=%d, max_drift_dist_weight=%e, "
+            "max_drift_objective=%e\n", INCREMENTAL_RESYNC_STEPS,
+            maxDrift[0], maxDrift[1]);
+    }
+#endif
+
+#if defined(SIM_STATS)
+    // The overhead is the extra time of the eat passes that collected the 
+    // statistics over the plain ones, plus reducing and printing them
+    if (pRank == MASTER_RANK) {
+        double overhead = statsReduceTime;
+        if (plainSteps > 0) {
+            overhead += statsEatTime - statsSteps * plainEatTime / plainSteps;
+        }
+        printf("stats interval=%d, max_overhead_percent=%f, emitted=%d, "
+            "skipped=%d, overhead_percent=%f\n", SIM_STATS_INTERVAL,
+            SIM_STATS_MAX_OVERHEAD * 100.0, statsSteps, statsSkipped,
+            overhead / elapsed_secs * 100.0);
+    }
+#endif
+
+#if defined(S_WORKSTEAL)
+    {
+        long localSteals = tile_scheduler_steals(tileScheduler);
+        long steals;
+
+        MPI_Reduce(&localSteals, &steals, 1, MPI_LONG, MPI_SUM, MASTER_RANK,
+            MPI_COMM_WORLD);
+        if (pRank == MASTER_RANK) {
+            printf("worksteal tile_size=%d, tiles=%d, steals=%ld\n", 
+                TILE_SCHEDULER_TILE_SIZE, tileScheduler->tileCount, steals);
+        }
+        tile_scheduler_free(tileScheduler);
+    }
+#endif
+
+#if defined(MORTON_REORDER)
+    {
+        double localTimes[2] = {sortTime, elapsed_secs - sortTime};
+        double times[2];
+
+        MPI_Reduce(localTimes, times, 2, MPI_DOUBLE, MPI_MAX, MASTER_RANK,
+            MPI_COMM_WORLD);
+        if (pRank == MASTER_RANK) {
+            printf("morton reorder_steps=%d, sorts=%d, sort_time=%f, "
+                "amortised_sort_time_per_step=%f, step_time_without_sort=%f\n",
+                MORTON_REORDER_STEPS, sorts, times[0],
+                times[0] / stepsRun, times[1] / stepsRun);
+        }
+    }
+
+    // Put the fishes back in the order of their ids for the gather
+    morton_sorter_restore(
+        mortonSorter,
+        localFishLake,
+        &fishIds,
+        workPartition->offset);
+    fishes = localFishLake->fishes;
+    morton_sorter_free(mortonSorter);
+#endif
+
+    sim_report_memory(
+        arena,
+        firstStepEnd - firstStepStart,
+        stepsRun > 1
+            ? (end - firstStepEnd) / (stepsRun - 1)
+            : 0.0,
+        pageFaults[1] - pageFaults[0],
+        pageFaults[2] - pageFaults[1]);
+
+#if defined(PERF_COUNTERS)
+    perf_counters_report(
+        perfCounters,
+        (double) fishAmount * stepsRun,
+        MASTER_RANK);
+    perf_counters_free(perfCounters);
+#endif
     
+#if defined(SIM_COMPACT)
+    if (pRank == MASTER_RANK) {
+        float capError = compact_fish_cap_error();
+
+        printf("storage kind=%s, bytes_per_fish=%d, full_bytes_per_fish=%d, "
+            "cap_weight_error=%f, cap_check=%s\n", STORAGE_STR,
+            (int) sizeof(SimFish), (int) sizeof(Fish), capError,
+            capError <= COMPACT_INIT_WEIGHT_STEP + COMPACT_WEIGHT_GAIN_STEP
+                ? "PASS"
+                : "FAIL");
+    }
+#endif
+
+#if !defined(SIM_SERVER)
+#if defined(COLLECT_FILE)
+    if (pRank == MASTER_RANK) {
+        collectFile = fopen(COLLECT_FILE, "wb");
+    }
+#endif
+    collectStart = omp_get_wtime();
+    TRACE_BEGIN(tracer, TRACE_COLLECT);
+
+#if defined(RMA_GATHER)
+    {
+        // Every process waits in rma_gather_free until the master is done
+        RmaGather* rmaGather = rma_gather_new(
+            fishes,
+            workPartition->size,
+            MPI_SIM_STORAGE_FISH,
+            sizeof(SimFish),
+            RMA_GATHER_CHUNK,
+            MPI_COMM_WORLD);
+
+        if (pRank == MASTER_RANK) {
+            collectBytes = rma_gather_pull(
+                rmaGather,
+                workPartition->sizes,
+                wSize,
+                sim_write_fishes,
+                collectFile);
+        }
+        rma_gather_free(rmaGather);
+    }
+#else
+#if defined(LOCAL_INIT)
+    // Only now the master needs room for every fish
+    if (pRank == MASTER_RANK) {
+        allFishes = (SimFish*) arena_alloc(
+            arena,
+            (size_t) fishAmount * sizeof(SimFish),
+            ARENA_MIN_ALIGN);
+    }
+#endif
     // Gatherv would allow the master process to gather the data back
     MPI_Gatherv(
-        localFishLake->fishes,
+        fishes,
         workPartition->size,
-        MPI_SIM_FISH,
+        MPI_SIM_STORAGE_FISH,
         allFishes,
         workPartition->sizes,
         workPartition->offsets,
-        MPI_SIM_FISH,
+        MPI_SIM_STORAGE_FISH,
         MASTER_RANK,
         MPI_COMM_WORLD
     );
 
+    if (pRank == MASTER_RANK) {
+        collectBytes = (size_t) fishAmount * sizeof(SimFish);
+        sim_write_fishes(allFishes, 0, fishAmount, collectFile);
+    }
+#endif
+
+    TRACE_END(tracer, TRACE_COLLECT);
+    collectTime = omp_get_wtime() - collectStart;
+    if (collectFile != NULL) {
+        fclose(collectFile);
+    }
+    sim_report_collect(collectTime, collectBytes);
+
+#if defined(SIM_COMPACT) && !defined(LOCAL_INIT)
+    // The master gets the fishes back at full precision
+    if (pRank == MASTER_RANK) {
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < fishAmount; k++) {
+            compact_fish_unpack(&(fishLake->fishes[k]), &(allFishes[k]));
+        }
+    }
+#endif
+
+#if defined(SIM_VERIFY)
+    if (pRank == MASTER_RANK) {
+        sim_reference_check_fishes(simReference, fishLake->fishes);
+        sim_reference_report(simReference);
+        sim_reference_free(simReference);
+    }
+#endif
+#endif
+
+#if defined(SIM_TRACE)
+    trace_export(tracer, TRACE_FILE, MPI_COMM_WORLD, MASTER_RANK);
+    trace_free(tracer);
+#endif
+
+    result->stepsRun = stepsRun;
+    result->timeTaken = elapsed_secs;
+    result->timeToFirstStep = firstStepStart - readyTime;
+    result->barycentre = barycentre;
+
     // === Clean ups by freeing up all memories ===
+#if !defined(LOCAL_INIT)
     // Master process free all fishes
     if (pRank == MASTER_RANK) {
         fish_lake_free(fishLake);
     }
+#endif
 
     work_parition_free(workPartition);
     fish_lake_free(localFishLake);
+}
+
+#if defined(SIM_SERVER)
+/**
+ * Runs the jobs read by the master until there are none left. Every job is
+ * broadcast to all processes, which keep their arena between the jobs so the
+ * memory is already mapped and touched when the next job starts. The logs and
+ * reports of the runs go to stderr, so stdout only carries the job records.
+ *
+ * @param arena the arena of this process
+ * @param address the job file or socket address the master reads jobs from
+ */
+static void sim_serve(Arena* arena, const char* address) {
+    SimServer* server = NULL;
+    SimJob job;
+    SimResult result;
+    int jobCount = 0;
+    int pRank;
+    int wSize;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &wSize);
+
+    if (pRank == MASTER_RANK) {
+        server = sim_server_new(address);
+    }
+    // The server keeps its own duplicate of stdout for the records
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    while (1) {
+        double readyTime;
+
+        if (pRank == MASTER_RANK) {
+            if (server == NULL || !sim_server_next_job(server, &job)) {
+                job.quit = 1;
+            }
+            job.id = jobCount;
+        }
+        MPI_Bcast(&job, sizeof(SimJob), MPI_BYTE, MASTER_RANK, MPI_COMM_WORLD);
+        if (job.quit) {
+            break;
+        }
+
+        readyTime = omp_get_wtime();
+        omp_set_num_threads(job.threads);
+        omp_set_schedule(SIM_SCHEDULE_KINDS[job.schedule], 0);
+        arena_reset(arena);
+
+        sim_run(arena, &job, readyTime, &result);
+
+        if (pRank == MASTER_RANK) {
+            sim_server_send_result(server, &job, &result, wSize);
+        }
+        jobCount++;
+    }
+
+    if (server != NULL) {
+        sim_server_free(server);
+    }
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    // Serves the fish arrays and any scratch buffer, so nothing is allocated
+    // inside the simulation steps
+    Arena* arena;
+#if !defined(SIM_SERVER)
+    // Start of the process, to find the time to the first step, and the same
+    // moment on the wall clock, so the launch of the process can be added
+    double launchTime = omp_get_wtime();
+    struct timespec launchEpoch;
+    SimJob job;
+    SimResult result;
+#endif
+
+    int pRank;
+    int wSize;
+
+#if !defined(SIM_SERVER)
+    clock_gettime(CLOCK_REALTIME, &launchEpoch);
+#endif
+
+#if defined(SIM_SERVER)
+    if (argc < 2) {
+        printf("Require the job file or unix:<socket path> as the only "
+            "argument\n");
+        return 1;
+    }
+#else
+    // Since the number of fishes are allocated on the heap at runtime, fish 
+    // amount can be dynamic. It would be easier to run the expirement with 
+    // the fish amount variable as an program argument.
+    if (argc < 2) {
+        printf("Require fish amount as the only argument\n Usage: \
+         ./simulation_sequential <fish amount>\n");
+        return 1;
+    }
+
+    sim_job_init(&job);
+    job.fishAmount = atoi(argv[1]);
+    job.simulationSteps = SIMULATION_STEPS;
+
+    if (job.fishAmount <= 0) {
+        printf("Invalid fish amount as argument\n");
+        return 1;
+    }
+
+    if (argc >= 3) {
+        int argSimulationSteps = atoi(argv[2]);
+        if (argSimulationSteps > 0) {
+            job.simulationSteps = argSimulationSteps;
+        }
+    }
+
+    // The same seed gives the same trajectory for the same amount of 
+    // processes and threads with the static schedule
+    if (argc >= 4) {
+        job.seed = (unsigned int) atoi(argv[3]);
+    }
+#endif
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &pRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &wSize);
+
+    // Initialise the custom data types with MPI
+    mpi_util_init_all_types();
+
+#if defined(SIM_STATS)
+    sim_stats_mpi_init();
+#endif
+
+#if defined(HIER_REDUCE)
+    hierReduce = hier_reduce_new(MPI_COMM_WORLD);
+#endif
+
+    // The verification also covers a single process
+#if !defined(SIM_VERIFY)
+    if (wSize < 2) {
+        printf("Program requires at least 2 processes\n");
+        return 1;
+    }
+#endif
+
+    arena = arena_new(ARENA_PAGE_KIND);
+
+#if defined(SIM_SERVER)
+    sim_serve(arena, argv[1]);
+#else
+    sim_run(arena, &job, launchTime, &result);
+
+    if (pRank == MASTER_RANK) {
+        printf("startup time_to_first_step=%f, first_step_epoch=%f\n",
+            result.timeToFirstStep, launchEpoch.tv_sec
+                + launchEpoch.tv_nsec * 1e-9 + result.timeToFirstStep);
+    }
+#endif
+
+    arena_free(arena);
+
+#if defined(HIER_REDUCE)
+    hier_reduce_free(hierReduce);
+#endif
+
+#if defined(SIM_STATS)
+    sim_stats_mpi_free();
+#endif
 
     //MPI gives warning for not freeing commited types
     mpi_util_free_all_types();    
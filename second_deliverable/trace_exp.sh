@@ -0,0 +1,50 @@
+#!/bin/sh
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --ntasks=4
+#SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=128
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+
+# Find the overhead of the event tracing by running the simulation with and 
+# without SIM_TRACE. The trace of the last traced run is kept in TRACE_FILE,
+# to be opened with Perfetto or chrome://tracing.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+TRACE_FILE="trace.json"
+
+OUT_DIR="exp_data"
+
+SIM_STEPS=100
+PROCESS_NUM=4
+THREAD_NUM=128
+REPEATS=3
+
+if [[ ! -d "$OUT_DIR" ]]
+then
+    mkdir $OUT_DIR
+fi
+
+OUT_FILE="${OUT_DIR}/trace_${SIM_STEPS}.txt"
+
+export OMP_NUM_THREADS=$THREAD_NUM
+
+for method in "" "-D SIM_TRACE"
+do
+    mpicc "${C_FILE_NAME}.c" -o $C_FILE_NAME $GCC_LIB_LINK -fopenmp $method \
+        -D TRACE_FILE=\"$TRACE_FILE\"
+
+    for fishAmount in 1000000 10000000 100000000
+    do
+        for repeat in $(seq $REPEATS)
+        do
+            srun -N $PROCESS_NUM -n $PROCESS_NUM -c $SLURM_CPUS_PER_TASK \
+                $C_FILE_NAME $fishAmount $SIM_STEPS >> $OUT_FILE
+        done
+    done
+done
+
+grep "fish_amount\|trace" $OUT_FILE
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+#SBATCH --account=courses0101
+#SBATCH --partition=debug
+#SBATCH --nodes=1
+#SBATCH --ntasks=8
+#SBATCH --cpus-per-task=16
+#SBATCH --time=00:30:00
+
+# Verifies the simulation against the reference engine for every build variant
+# with 1 to 8 processes on a single machine. Every run uses the same seed, so
+# every variant and split of the fishes is checked against the same golden 
+# trajectory. Exits with a non zero status if any run failed.
+
+GCC_LIB_LINK='-lm'
+C_FILE_NAME="sim_mpi"
+VERIFY_FILE_NAME="sim_mpi_verify"
+
+FISH_AMOUNT=${FISH_AMOUNT:-200000}
+SIM_STEPS=${SIM_STEPS:-20}
+SEED=5507
+THREAD_NUM=${THREAD_NUM:-4}
+
+VARIANTS=(
+    "-D S_STATIC"
+    "-D S_GUIDED"
+    "-D S_DYNAMIC"
+    "-D S_WORKSTEAL"
+    "-D INCREMENTAL"
+    "-D MORTON_REORDER"
+    "-D HIER_REDUCE"
+    "-D SIM_STATS"
+    "-D BOUNDARY_CLAMP"
+    "-D BOUNDARY_REFLECT"
+    "-D BOUNDARY_WRAP"
+)
+
+FAILED=0
+
+for variant in "${VARIANTS[@]}"
+do
+    mpicc "${C_FILE_NAME}.c" -o $VERIFY_FILE_NAME $GCC_LIB_LINK -fopenmp \
+        -D SIM_VERIFY $variant || exit 1
+
+    for processes in 1 2 3 4 5 6 7 8
+    do
+        for threads in 1 $THREAD_NUM
+        do
+            result=$(OMP_NUM_THREADS=$threads mpirun -n $processes \
+                $VERIFY_FILE_NAME $FISH_AMOUNT $SIM_STEPS $SEED \
+                | grep "^verify steps")
+
+            echo "variant=${variant}, processes=${processes}, threads=${threads}, ${result}"
+            if [[ $result != *"result=PASS"* ]]
+            then
+                FAILED=1
+            fi
+        done
+    done
+done
+
+exit $FAILED